@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <functional>
 #include <vector>
 #include <unordered_map>
 #include <initializer_list>
@@ -15,10 +16,13 @@ class AFDataFrame {
 private:
     typedef std::initializer_list<std::string> str_list;
     typedef std::initializer_list<bool> bool_list;
+    typedef std::function<af::array(af::array const &lhsRows, af::array const &rhsRows)> PairFilter;
     std::vector<Column> _columns;
     std::string _name;
     std::unordered_map<std::string, unsigned int> _nameToCol;
     std::unordered_map<unsigned int, std::string> _colToName;
+
+    AFDataFrame _withDefaultRow() const;
 public:
     AFDataFrame() = default;
 
@@ -66,20 +70,56 @@ public:
 
     void sortBy(str_list columns, bool_list isAscending = bool_list());
 
+    void applySCD2(std::string const &businessKey, std::string const &effectiveDate, std::string const &skColumn);
+
+    void appendSCD2(AFDataFrame &delta, std::string const &businessKey, std::string const &effectiveDate,
+                    std::string const &skColumn);
+
+    void upsert(AFDataFrame &delta, std::string const &key);
+
+    void rangeWindow(std::string const &partition, std::string const &order, std::string const &value, unsigned int days,
+                     bool isMaximum, std::string const &name);
+
     AFDataFrame equiJoin(AFDataFrame const &rhs, int lhs_column, int rhs_column) const;
 
+    AFDataFrame equiJoin(AFDataFrame const &rhs, str_list lhsKeys, str_list rhsKeys,
+                         PairFilter const &filter = nullptr) const;
+
+    AFDataFrame equiJoin(AFDataFrame const &rhs, str_list lhsKeys, str_list rhsKeys, JoinType type,
+                         PairFilter const &filter = nullptr, af::array *unmatched = nullptr) const;
+
+    AFDataFrame asOfJoin(AFDataFrame const &rhs, std::string const &key, std::string const &date,
+                         std::string const &rhsKey, std::string const &from, std::string const &to) const;
+
     void nameColumn(const std::string &name, unsigned int column);
 
     std::string name(const std::string &str);
 
     void flushToHost();
 
+    void toDevice() const;
+
+    /* Bytes the frame currently holds on the device, flushed columns count as zero */
+    size_t deviceBytes() const;
+
+    /* Bytes the frame takes on the device once loaded, flushed columns included */
+    size_t bytes() const;
+
+    void writeColumnar(std::string const &directory, std::string const &name = "", bool compress = true) const;
+
+    static AFDataFrame readColumnar(std::string const &directory, std::string const &name);
+
+    void writeDelimited(std::string const &path, char delim = '|') const;
+
     void clear();
 
     static std::pair<af::array, af::array> hashCompare(Column const &lhs, Column const &rhs);
 
     static std::pair<af::array, af::array> hashCompare(af::array const &left, af::array const &right);
 
+    static std::pair<af::array, af::array> keyPairs(std::vector<Column const*> const &lhs,
+                                                    std::vector<Column const*> const &rhs);
+
     static std::pair<af::array, af::array> crossCompare(Column const &lhs, Column const &rhs);
 
     static std::pair<af::array, af::array> crossCompare(const af::array &left, const af::array &right);
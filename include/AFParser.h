@@ -3,10 +3,22 @@
 
 #include "Enums.h"
 #include <arrayfire.h>
+#include <string>
+#include <vector>
 
 
 class Column;
 
+/* A field to parse: its position in the record and the type it is parsed as. DATE, TIME and DATETIME fields are
+ * read from delimited YYYYMMDD text */
+struct ParseField {
+    int column;
+    DataType type;
+};
+
+/* The fields a loader parses, in the order they are added to its frame */
+typedef std::vector<ParseField> Schema;
+
 class AFParser {
 private:
     af::array _data = af::array(0, u8);
@@ -35,6 +47,11 @@ public:
     Column asDateTime(int column, DateFormat inputFormat = YYYYMMDD) const;
 
     Column asTime(int column, bool isDelimited) const;
+
+    Column parse(ParseField const &field) const;
+
+    /* Identifies a schema, so anything keyed on it changes when a field moves or changes type */
+    static std::string describe(Schema const &schema);
 };
 
 
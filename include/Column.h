@@ -2,37 +2,38 @@
 #define ARRAYFIRE_TPCDI_COLUMN_H
 
 #include <arrayfire.h>
+#include <memory>
 #include <unordered_map>
 #include <utility>
 #include "Enums.h"
 #include "AFTypes.h"
+#include "SpillManager.h"
 
 /* Wrapper for array to simplify access for different types (especially strings) */
 class Column {
     typedef af::array::array_proxy Proxy;
-    af::array _device;
-    af::array _idx = af::array(0, u64);
-    void *_host = nullptr;
-    unsigned long long *_host_idx = nullptr;
-    af::dim4 _dimension = af::dim4(0);
-    af::dim4 _idxDimension = af::dim4(0);
+    mutable af::array _device;
+    mutable af::array _idx = af::array(0, u64);
+    /* Flushed buffers, owned by the SpillManager and brought back to the device on first access */
+    mutable std::shared_ptr<SpillManager::Block> _hostData;
+    mutable std::shared_ptr<SpillManager::Block> _hostIdx;
+    /* Packed validity bitmap, see Utils::packBits. Empty when every row is valid */
+    af::array _valid = af::array(0, u32);
     DataType _type = STRING;
 
+    inline void _reload() const { if (_hostData || _hostIdx) toDevice(); }
+
     af::array _fnv1a() const;
 
     af::array _wordHash() const;
 
-    af::array _datetimeHash() const;
-
-    af::array _dateHash() const;
+    /* Dates are stored as s32 days since 1970-01-01, times as s32 seconds since midnight and
+     * datetimes as s64 seconds since 1970-01-01 00:00:00. These convert from/to the textual keys */
+    static af::array _encodeDate(af::array const &key, DateFormat format);
 
-    inline af::array _timeHash() const { return _dateHash(); }
+    static af::array _encodeTime(af::array const &key);
 
-    static af::array _dehashDate(af::array const &key, DateFormat format);
-
-    static af::array _dehashTime(af::array const &key) {
-        return join(0, key / 10000, key / 100 % 100, key % 100).as(u16);
-    }
+    static af::array _decodeDate(af::array const &days);
 
     void _generateStringIndex();
 
@@ -67,10 +68,7 @@ public:
 
     Column(Column const &other) = default;
 
-    virtual ~Column() {
-        if (_host) free(_host);
-        if (_host_idx) free(_host_idx);
-    }
+    virtual ~Column() = default;
 
     Column &operator=(Column &&other) noexcept;
 
@@ -92,6 +90,8 @@ public:
 
     void toHost();
 
+    void toDevice() const;
+
     void clearDevice();
 
     template<typename T>
@@ -99,6 +99,8 @@ public:
 
     af::array hash(bool sortable = false) const;
 
+    af::array dateKey() const;
+
     void printColumn() const;
 
     Column left(unsigned int length) const;
@@ -107,15 +109,35 @@ public:
 
     Column trim(unsigned int start, unsigned int length) const;
 
-    inline af::array const &index() const { return _idx; }
+    /* Takes a packed bitmap of length() bits, an empty bitmap marks every row valid. The bitmap is kept as given,
+     * producers that know every row is valid pass an empty one */
+    void validity(af::array const &bits);
 
-    inline af::array const &data() const { return _device; }
+    /* b8 row mask with false for null rows */
+    af::array isValid() const;
 
-    inline af::dim4 dims() const { return _device.dims(); }
+    inline af::array const &validity() const { return _valid; }
 
-    inline bool isempty() const { return _device.isempty(); }
+    inline bool hasNulls() const { return !_valid.isempty(); }
 
-    inline dim_t dims(unsigned int const i) const { return _device.dims(i); }
+    /* Does not reload a flushed column */
+    inline size_t deviceBytes() const { return _device.bytes() + _idx.bytes() + _valid.bytes(); }
+
+    /* Device bytes once loaded, flushed buffers included */
+    inline size_t bytes() const {
+        return (_hostData ? _hostData->bytes() : _device.bytes()) + (_hostIdx ? _hostIdx->bytes() : _idx.bytes()) +
+               _valid.bytes();
+    }
+
+    inline af::array const &index() const { _reload(); return _idx; }
+
+    inline af::array const &data() const { _reload(); return _device; }
+
+    inline af::dim4 dims() const { _reload(); return _device.dims(); }
+
+    inline bool isempty() const { _reload(); return _device.isempty(); }
+
+    inline dim_t dims(unsigned int const i) const { _reload(); return _device.dims(i); }
 
     inline DataType type() const { return _type; }
 
@@ -124,31 +146,34 @@ public:
         return _type;
     }
 
-    inline Proxy row(int const i) const { return _device.row(i); }
+    inline Proxy row(int const i) const { _reload(); return _device.row(i); }
 
-    inline Proxy col(int const i) const { return _device.col(i); }
+    inline Proxy col(int const i) const { _reload(); return _device.col(i); }
 
-    inline Proxy rows(int i, int j) const { return _device.rows(i, j); }
+    inline Proxy rows(int i, int j) const { _reload(); return _device.rows(i, j); }
 
-    inline Proxy cols(int i, int j) const { return _device.cols(i, j); }
+    inline Proxy cols(int i, int j) const { _reload(); return _device.cols(i, j); }
 
-    inline Proxy irow(int const i) const { return _idx.row(i); }
+    inline Proxy irow(int const i) const { _reload(); return _idx.row(i); }
 
-    inline Proxy icol(int const i) const { return _idx.col(i); }
+    inline Proxy icol(int const i) const { _reload(); return _idx.col(i); }
 
-    inline Proxy irows(int i, int j) const { return _idx.rows(i, j); }
+    inline Proxy irows(int i, int j) const { _reload(); return _idx.rows(i, j); }
 
-    inline Proxy icols(int i, int j) const { return _idx.cols(i, j); }
+    inline Proxy icols(int i, int j) const { _reload(); return _idx.cols(i, j); }
 
-    inline Proxy index(af::index const &x) const { return _idx(x); }
+    inline Proxy index(af::index const &x) const { _reload(); return _idx(x); }
 
-    inline Proxy index(af::index const &x, af::index const &y) const { return _idx(x, y); }
+    inline Proxy index(af::index const &x, af::index const &y) const { _reload(); return _idx(x, y); }
 
-    inline Proxy operator()(af::index const &x) const { return _device(x); }
+    inline Proxy operator()(af::index const &x) const { _reload(); return _device(x); }
 
-    inline Proxy operator()(af::index const &x, af::index const &y) const { return _device(x, y); }
+    inline Proxy operator()(af::index const &x, af::index const &y) const { _reload(); return _device(x, y); }
 
-    inline size_t length() const { return (_type == STRING) ? _idx.dims(1) : _device.dims(1); }
+    inline size_t length() const {
+        _reload();
+        return (_type == STRING) ? _idx.dims(1) : _device.dims(1);
+    }
 
 
 
@@ -0,0 +1,51 @@
+#ifndef ARRAYFIRE_TPCDI_COLUMNSTORE_H
+#define ARRAYFIRE_TPCDI_COLUMNSTORE_H
+
+#include <arrayfire.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Column.h"
+
+/* Persisted tables. A table is a directory holding one column file per column, named by position. Each file is
+ * a SpillManager column file with the string index (strings only), the packed validity bitmap (columns with nulls
+ * only) and a Footer appended after the buffer */
+namespace ColumnStore {
+    enum Compression : uint32_t { NONE, FRAME_OF_REFERENCE };
+
+    enum Flags : uint32_t { HAS_VALIDITY = 1 };
+
+    struct Footer {
+        char name[48];
+        uint32_t dataType;
+        uint32_t afType;
+        uint32_t compression;
+        uint32_t flags;
+        uint64_t length;
+        uint64_t indexBytes;
+        union Bound { int64_t i; uint64_t u; double f; } min, max;
+        char magic[8];
+    };
+
+    /* Column buffers copied to host and ready to be written without touching the device again */
+    struct Staged {
+        std::vector<unsigned char> data;
+        std::vector<unsigned char> trailer;
+        af::dim4 dims;
+        af::dtype type;
+    };
+
+    Staged stage(Column const &column, std::string const &name, bool compress = true);
+
+    void write(std::string const &path, Staged const &staged);
+
+    Column read(std::string const &path, std::string &name);
+
+    std::string tableDirectory(std::string const &directory, std::string const &table, bool create = false);
+
+    std::string columnPath(std::string const &table, unsigned int column);
+
+    unsigned int columnCount(std::string const &table);
+}
+
+#endif //ARRAYFIRE_TPCDI_COLUMNSTORE_H
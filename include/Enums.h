@@ -12,4 +12,11 @@ enum DataType {
     INT, SHORT, LONG, UINT, UCHAR, USHORT, ULONG, FLOAT, DOUBLE, STRING, BOOL, DATE, TIME, DATETIME
 };
 
+enum JoinType {
+    INNER,
+    LEFT,
+    SEMI,
+    ANTI,
+};
+
 #endif //ARRAYFIRE_TPCDI_ENUMS_H
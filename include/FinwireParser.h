@@ -7,8 +7,10 @@
 
 #include "AFParser.h"
 #include "AFDataFrame.h"
+#include "MemoryManager.h"
 #include <functional>
 #include <string>
+#include <vector>
 
 struct Finwire {
 public:
@@ -30,16 +32,42 @@ private:
     enum RecordType {
         FIN = 0, CMP = 1, SEC = 2
     };
+    enum FieldType {
+        STR, CIK, YMD, YMD_HMS, U8, U16, U64, F64
+    };
+    struct Field {
+        int length;
+        FieldType type;
+    };
     char const _search[3][4] = {"FIN", "CMP", "SEC"};
-    int const _FINLengths[18] = {15, 3, 4, 1, 8, 8, 17, 17, 12, 12, 12, 17, 17, 17, 13, 13, 60, 0};
-    int const _CMPLengths[17] = {15, 3, 60, 10, 4, 2, 4, 8, 80, 80, 12, 25, 20, 24, 46, 150, 0};
-    int const _SECLengths[13] = {15, 3, 15, 6, 4, 70, 6, 13, 8, 8, 12, 60, 0};
+    Field const _FINFields[18] = {{15, YMD_HMS}, {3, STR}, {4, U16}, {1, U8}, {8, YMD}, {8, YMD},
+                                  {17, F64}, {17, F64}, {12, F64}, {12, F64}, {12, F64}, {17, F64},
+                                  {17, F64}, {17, F64}, {13, U64}, {13, U64}, {60, CIK}, {0, STR}};
+    Field const _CMPFields[17] = {{15, YMD_HMS}, {3, STR}, {60, STR}, {10, U64}, {4, STR}, {2, STR}, {4, STR},
+                                  {8, YMD}, {80, STR}, {80, STR}, {12, STR}, {25, STR}, {20, STR}, {24, STR},
+                                  {46, STR}, {150, STR}, {0, STR}};
+    Field const _SECFields[13] = {{15, YMD_HMS}, {3, STR}, {15, STR}, {6, STR}, {4, STR}, {70, STR}, {6, STR},
+                                  {13, U64}, {8, YMD}, {8, YMD}, {12, F64}, {60, CIK}, {0, STR}};
     af::array _data;
     af::array _indexer;
 
-    Column _extract(const af::array &start, unsigned int length, RecordType const &type) const;
+    FinwireParser() = default;
+
+    void _upload(std::string &text);
+
+    af::array _classify() const;
+
+    af::array _fieldIndexer(af::array const &start, Field const *fields, std::vector<int> const &group) const;
+
+    void _gatherStrings(af::array const &start, Field const *fields, std::vector<int> const &group,
+                        std::vector<Column> &output) const;
+
     template <typename T>
-    Column parse(const af::array& start, unsigned int length) const;
+    void _parseNumbers(af::array const &start, Field const *fields, std::vector<int> const &group,
+                       std::vector<Column> &output) const;
+
+    AFDataFrame _decode(af::array const &rows, Field const *fields) const;
+
     af::array filterRowsByCategory(const RecordType &type) const;
 
 public:
@@ -49,15 +77,21 @@ public:
 
     AFDataFrame extractSec() const;
 
+    Finwire extractData() const;
+
     explicit FinwireParser(std::vector<std::string> const &files);
 
+    static Finwire parseFiles(std::vector<std::string> const &files);
+
+    /* Identifies the record layouts, so anything keyed on it changes when a field does */
+    static std::string describe();
+
     virtual ~FinwireParser() {
+        auto const bytes = _data.bytes() + _indexer.bytes();
         _data = af::array(0, u8);
         _indexer = af::array(0, u64);
-        af::deviceGC();
+        MemoryManager::instance().released(bytes);
     }
-
-    inline Finwire extractData() const { return Finwire(extractCmp(), extractFin(), extractSec()); }
 };
 
 #endif //ARRAYFIRE_TPCDI_FINWIREPARSER_H
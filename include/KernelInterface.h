@@ -10,13 +10,19 @@ af::array hashIntersect(af::array const &bag, AFHashTable const &ht);
 
 void joinScatter(af::array &lhs, af::array &rhs, unsigned long long equals);
 
-af::array stringGather(af::array const &input, af::array &indexer);
+af::array stringGather(af::array const &input, af::array &indexer, bool rtrim = false);
+
+/* Builds "+C (A) L E" phone strings. Parts is 8 x rows holding the start and length of the country, area, local
+ * and extension strings in input, the index of the result is written to indexer */
+af::array phoneFormat(af::array const &input, af::array const &parts, af::array &indexer);
 
 af::array stringComp(af::array const &lhs, af::array const &rhs, af::array const &l_idx, af::array const &r_idx);
 
 af::array stringComp(af::array const &lhs, char const *rhs, af::array const &l_idx);
 
+/* Rows with an empty field parse to 0. When valid is given it receives the packed validity bitmap of the result,
+ * with a cleared bit for every empty field, or an empty bitmap when no field is empty */
 template<typename T>
-af::array numericParse(af::array const &input, af::array const &indexer);
+af::array numericParse(af::array const &input, af::array const &indexer, af::array *valid = nullptr);
 
 #endif //ARRAYFIRE_TPCDI_KERNELINTERFACE_H
@@ -15,12 +15,19 @@ void lauchJoinScatter(unsigned long long const *l_idx, unsigned long long const
 void launchStringGather(unsigned char *output, unsigned long long const *idx, unsigned char const *input,
         unsigned long long output_size, unsigned long long rows, unsigned long long loops);
 
+void launchStringTrim(unsigned long long *idx, unsigned char const *input, unsigned long long rows);
+
+void launchPhoneLength(unsigned long long *idx, unsigned long long const *parts, unsigned long long rows);
+
+void launchPhoneFormat(unsigned char *output, unsigned long long const *idx, unsigned char const *input,
+        unsigned long long const *parts, unsigned long long rows);
+
 void launchStringComp(bool *output, unsigned char const *left, unsigned char const *right,
         unsigned long long const *l_idx, unsigned long long const *r_idx, unsigned int const* mask, unsigned long long rows);
 
 template<typename T>
-void launchNumericParse(T *output, unsigned long long const * idx, unsigned char const *input,
-        unsigned long long rows);
+void launchNumericParse(T *output, unsigned int *valid, unsigned int *nulls, unsigned long long const * idx,
+        unsigned char const *input, unsigned long long rows);
 
 void launchStringComp(bool *output, unsigned char const *left, unsigned char const *right,
         unsigned long long const *l_idx, unsigned long long rows, unsigned long long loops);
@@ -1,31 +1,91 @@
 #ifndef ARRAYFIRE_TPCDI_LOGGER_H
 #define ARRAYFIRE_TPCDI_LOGGER_H
 
-#include <unordered_map>
 #include <arrayfire.h>
 #include <iostream>
 #include <fstream>
-#include <vector>
+#include <string>
+#include <utility>
 
 #ifdef ENABLE_ITT
     #include <ittnotify.h>
 #endif
 
+/* Timers are spans on a per-thread stack, a span started while another is open on the same thread becomes its
+ * child; the first span of a worker thread becomes a child of the span its work was handed out from. Closed spans
+ * keep their thread, parent and the rows and bytes they processed. Their durations are also collected per name for
+ * result.csv */
 namespace Logger {
-    static std::unordered_map<std::string, std::vector<double>> _times;
-    static std::unordered_map<std::string, af::timer> _timers;
     inline std::string& directory(std::string const &dir = "") {
         static std::string directory;
         if (!dir.empty()) directory = dir;
         return directory;
     }
 
+    /* Output rows of a span that did not count them */
+    constexpr unsigned long long UNCOUNTED = ~0ULL;
+
+    /* Off by default. Exact output and byte counts of filtering kernels take a device reduction, and a sync, inside
+     * the span they measure; without them those kernels report sizes already known on the host */
+    inline bool &exactCounts() {
+        static bool exact = false;
+        return exact;
+    }
+
     void startTimer(std::string const &name = "main");
 
+    /* Closes the innermost open span of that name on this thread, along with any span left open inside it */
     void logTime(std::string const &name = "main", bool show = true);
 
+    /* Span over a scope, closed by stop() or else on whatever return leaves the scope */
+    class ScopedTimer {
+        std::string _name;
+        bool _show;
+        bool _open = true;
+    public:
+        explicit ScopedTimer(std::string name, bool show = false) : _name(std::move(name)), _show(show) {
+            startTimer(_name);
+        }
+
+        ScopedTimer(ScopedTimer const &other) = delete;
+
+        ScopedTimer &operator=(ScopedTimer const &other) = delete;
+
+        /* Closing syncs the device, a failing sync while unwinding must not terminate */
+        ~ScopedTimer() {
+            try {
+                stop();
+            } catch (...) {
+            }
+        }
+
+        inline void stop() {
+            if (_open) logTime(_name, _show);
+            _open = false;
+        }
+    };
+
+    /* Id of the innermost open span on this thread, 0 when none is open */
+    unsigned long long currentSpan();
+
+    /* Makes parent the parent of spans this thread opens while it has none open, called first in a worker */
+    void inheritSpan(unsigned long long parent);
+
+    /* Adds to the rows and bytes processed by the innermost open span on this thread. Spans with a count are also
+     * summed per name into operator throughput, selectivity only over the rows whose output was counted */
+    void annotate(unsigned long long rows, unsigned long long bytes, unsigned long long outputRows = UNCOUNTED);
+
+    /* Adds a value that is not a time, e.g. a counter, to the row of that name in result.csv */
+    void record(std::string const &name, double value);
+
     void sendToCSV(int const scale);
 
+    /* Writes the closed spans as Chrome trace_event JSON, viewable in chrome://tracing or Perfetto */
+    void sendToTrace(std::string const &file = "trace.json");
+
+    /* Writes calls, time, rows in and out, selectivity, rows/s, MB/s and ns per row of every annotated operator */
+    void sendThroughput(std::string const &file = "throughput.csv");
+
     #ifdef ENABLE_ITT
     static __itt_domain* _domain = __itt_domain_create("AF_tpcdi");
     #endif
@@ -0,0 +1,89 @@
+#ifndef ARRAYFIRE_TPCDI_MEMORYMANAGER_H
+#define ARRAYFIRE_TPCDI_MEMORYMANAGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class AFDataFrame;
+
+/* Keeps device memory under a budget. Tracked frames are ordered by last use; when the arrays in use exceed the
+ * budget after cached buffers are freed, the coldest unpinned frames are flushed to the SpillManager. Frames a
+ * running task reads or writes are pinned and never flushed */
+class MemoryManager {
+public:
+    struct Stats {
+        size_t collections = 0;
+        size_t deviceGCs = 0;
+        size_t evictedFrames = 0;
+        size_t evictedBytes = 0;
+        size_t peakLocked = 0;
+    };
+
+    static MemoryManager &instance();
+
+    void budget(size_t bytes);
+
+    inline size_t budget() const { return _budget; }
+
+    /* Cached buffers are freed once this many bytes have been released since the last device GC */
+    inline void releaseThreshold(size_t const bytes) { _releaseThreshold = bytes; }
+
+    void track(std::string const &name, AFDataFrame *frame);
+
+    void untrack(std::string const &name);
+
+    /* Pinning a flushed frame brings it back to the device, so concurrent readers never reload it themselves */
+    void pin(std::string const &name);
+
+    void unpin(std::string const &name);
+
+    void touch(std::string const &name);
+
+    /* Size of a frame once loaded, read while no eviction can flush it */
+    size_t footprint(AFDataFrame const &frame);
+
+    /* Called between operators. Frees cached buffers when they dominate the allocation and evicts cold frames
+     * when the budget is exceeded */
+    void collect();
+
+    /* Called when device buffers are dropped, takes no lock so flushes made during an eviction can report */
+    void released(size_t bytes);
+
+    Stats stats();
+
+    /* Sends the counters to the Logger */
+    void report();
+
+private:
+    struct Entry {
+        AFDataFrame *frame = nullptr;
+        unsigned int pins = 0;
+        bool listed = false;
+        /* Its first pin is bringing it back to the device */
+        bool loading = false;
+        std::list<std::string>::iterator lru;
+    };
+    std::mutex _lock;
+    std::condition_variable _loaded;
+    std::unordered_map<std::string, Entry> _frames;
+    /* Coldest frame at the back */
+    std::list<std::string> _order;
+    size_t _budget = SIZE_MAX;
+    std::atomic<size_t> _releaseThreshold{1000000000};
+    std::atomic<size_t> _released{0};
+    std::atomic<size_t> _deviceGCs{0};
+    Stats _stats;
+
+    MemoryManager() = default;
+
+    void _deviceGC();
+
+    void _evict(size_t locked);
+};
+
+#endif //ARRAYFIRE_TPCDI_MEMORYMANAGER_H
@@ -0,0 +1,44 @@
+#ifndef ARRAYFIRE_TPCDI_PREFETCHER_H
+#define ARRAYFIRE_TPCDI_PREFETCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/* Reads input files ahead of the loaders on a dedicated I/O thread, in the order they were scheduled.
+ * Utils::loadFile takes a finished read instead of going to disk. At most limit() bytes are held ahead;
+ * a file larger than that is only advised into the page cache */
+class Prefetcher {
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::deque<std::string> _queue;
+    std::unordered_map<std::string, std::string> _ready;
+    std::string _reading;
+    size_t _held = 0;
+    size_t _limit = 1llU << 30U;
+    bool _stop = false;
+    std::thread _thread;
+
+    Prefetcher() = default;
+
+    void _run();
+
+public:
+    ~Prefetcher();
+
+    static Prefetcher &instance();
+
+    void schedule(std::vector<std::string> const &files);
+
+    bool take(std::string const &file, std::string &text);
+
+    void discard(std::string const &file);
+
+    void limit(size_t bytes);
+};
+
+#endif //ARRAYFIRE_TPCDI_PREFETCHER_H
@@ -0,0 +1,107 @@
+#ifndef ARRAYFIRE_TPCDI_SPILLMANAGER_H
+#define ARRAYFIRE_TPCDI_SPILLMANAGER_H
+
+#include <arrayfire.h>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Host side storage for flushed columns. Buffers stay resident in memory until the resident total exceeds
+ * the budget, then the least recently used ones are written to a column file and memory-mapped when read.
+ * Victims are chosen under the lock; file writes, maps and uploads run outside it */
+class SpillManager {
+public:
+    class Block {
+        friend class SpillManager;
+        af::dim4 _dims;
+        af::dtype _type;
+        size_t _bytes;
+        void *_memory = nullptr;
+        std::string _path;
+        std::list<Block*>::iterator _lru;
+        /* Being written to its file, the buffer stays until the write is done */
+        bool _writing = false;
+        /* Loads copying from the buffer outside the lock */
+        unsigned int _readers = 0;
+    public:
+        Block(af::dim4 const &dims, af::dtype type, size_t bytes) : _dims(dims), _type(type), _bytes(bytes) {}
+
+        Block(Block const &other) = delete;
+
+        Block &operator=(Block const &other) = delete;
+
+        ~Block();
+
+        inline af::dim4 const &dims() const { return _dims; }
+
+        inline af::dtype type() const { return _type; }
+
+        inline size_t bytes() const { return _bytes; }
+
+        inline bool isResident() const { return _memory != nullptr; }
+    };
+
+    /* Layout of a column file: this header, padded to 64 bytes, followed by the raw column buffer and an
+     * optional trailer */
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t type;
+        int64_t dims[4];
+        uint64_t bytes;
+    };
+
+    static SpillManager &instance();
+
+    std::shared_ptr<Block> spill(af::array const &array);
+
+    af::array load(Block &block);
+
+    void directory(std::string const &dir);
+
+    void budget(size_t bytes);
+
+    inline size_t budget() const { return _budget; }
+
+    inline size_t residentBytes() const { return _residentBytes; }
+
+    inline size_t spilledBytes() const { return _spilledBytes; }
+
+    static size_t constexpr headerSize = 64;
+
+    /* Anything in trailer is appended after the buffer, the header only describes the buffer itself */
+    static void writeFile(std::string const &path, void const *data, af::dim4 const &dims, af::dtype type, size_t bytes,
+                          void const *trailer = nullptr, size_t trailerBytes = 0);
+
+    static void *mapFile(std::string const &path, FileHeader &header, size_t &length);
+
+    static void unmapFile(void *map, size_t length);
+
+private:
+    std::mutex _lock;
+    std::condition_variable _idle;
+    std::list<Block*> _resident;
+    std::string _directory = "./";
+    size_t _budget = SIZE_MAX;
+    size_t _residentBytes = 0;
+    size_t _spilledBytes = 0;
+    unsigned long long _counter = 0;
+
+    SpillManager() = default;
+
+    /* Takes the least recently used blocks off the resident list until it fits the budget, called under the lock */
+    std::vector<Block*> _victims();
+
+    /* Writes the victims to their files without the lock and frees their buffers once no load reads them */
+    void _evict(std::vector<Block*> const &victims);
+
+    void _doneReading(Block &block);
+
+    void _release(Block *block);
+};
+
+#endif //ARRAYFIRE_TPCDI_SPILLMANAGER_H
@@ -0,0 +1,43 @@
+#ifndef ARRAYFIRE_TPCDI_STAGINGCACHE_H
+#define ARRAYFIRE_TPCDI_STAGINGCACHE_H
+
+#include <string>
+#include <vector>
+#include "AFDataFrame.h"
+
+/* Parsed staging frames kept as column files between runs. Caching is off until a directory is set */
+namespace StagingCache {
+    inline std::string &directory(std::string const &dir = "") {
+        static std::string directory;
+        if (!dir.empty()) directory = dir;
+        return directory;
+    }
+
+    /* Identifies a parsed frame by table name, parse schema and the path, size and modification time of every
+     * input file, so a change to any of them misses the cache. The id starts with a prefix naming the table and
+     * input paths alone, shared by every version of the entry. The key is empty while caching is off */
+    class Key {
+        std::string _table;
+        std::string _prefix;
+        std::string _id;
+        std::vector<std::string> _inputs;
+    public:
+        Key(std::string table, std::vector<std::string> const &inputs, std::string const &schema);
+
+        inline std::string const &table() const { return _table; }
+
+        inline std::string const &prefix() const { return _prefix; }
+
+        inline std::string const &id() const { return _id; }
+
+        inline std::vector<std::string> const &inputs() const { return _inputs; }
+
+        inline bool valid() const { return !_id.empty(); }
+    };
+
+    bool fetch(Key const &key, AFDataFrame &frame, std::string const &part = "");
+
+    void store(Key const &key, AFDataFrame const &frame, std::string const &part = "");
+}
+
+#endif //ARRAYFIRE_TPCDI_STAGINGCACHE_H
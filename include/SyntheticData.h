@@ -0,0 +1,26 @@
+#ifndef ARRAYFIRE_TPCDI_SYNTHETICDATA_H
+#define ARRAYFIRE_TPCDI_SYNTHETICDATA_H
+
+#include <arrayfire.h>
+#include "Column.h"
+
+/* Generated columns for measuring kernels in isolation. Everything is drawn from ArrayFire's default random engine,
+ * so a fixed seed gives the same data on every backend */
+namespace Synthetic {
+    void seed(unsigned long long value);
+
+    /* Keys in [0, distinct). A skew of 0 is uniform, larger skews put more of the rows on the low keys */
+    Column keys(dim_t rows, unsigned long long distinct, double skew = 0);
+
+    /* Lowercase strings whose lengths are spread evenly around the given mean, never shorter than one character */
+    Column strings(dim_t rows, unsigned int length);
+
+    /* The same string for the same key, so key skew carries over to the strings */
+    Column keyedStrings(Column const &keys, unsigned int length);
+
+    /* Decimal text of random values as a string column, in the layout numericParse reads. Integer types get values
+     * that fit the type, floating point ones get six fraction digits. A share of the rows is left empty */
+    Column numericText(dim_t rows, af::dtype type, double empty = 0);
+}
+
+#endif //ARRAYFIRE_TPCDI_SYNTHETICDATA_H
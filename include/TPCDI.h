@@ -64,20 +64,28 @@ AFDataFrame loadDimBroker(char const *directory, AFDataFrame &dimDate);
 
 AFDataFrame loadStagingCustomer(char const *directory);
 
-AFDataFrame loadStagingCashBalances(char const *directory);
+AFDataFrame loadStagingCashBalances(char const *directory, bool isIncremental = false);
 
 AFDataFrame loadStagingWatches(char const *directory);
 
-AFDataFrame loadStagingTrade(char const *directory);
+AFDataFrame loadStagingTrade(char const *directory, bool isIncremental = false);
 
 AFDataFrame loadStagingTradeHistory(char const *directory);
 
+AFDataFrame loadStagingHoldings(char const *directory, bool isIncremental = false);
+
+AFDataFrame loadStagingIncrementalCustomer(char const *directory);
+
+AFDataFrame loadStagingAccount(char const *directory);
+
 Customer splitCustomer(AFDataFrame &&s_Customer);
 
 AFDataFrame loadDimCustomer(Customer &s_Customer, AFDataFrame &taxRate, AFDataFrame &prospect);
 
 AFDataFrame loadDimAccount(Customer &stagingCustomer);
 
+void markProspectCustomers(AFDataFrame &prospect, AFDataFrame &dimCustomer);
+
 AFDataFrame loadDimCompany(AFDataFrame &&s_Company, AFDataFrame &industry, AFDataFrame &statusType);
 
 AFDataFrame loadFinancial(AFDataFrame &&s_Financial, AFDataFrame const &dimCompany);
@@ -86,4 +94,39 @@ AFDataFrame loadDimSecurity(AFDataFrame &&s_Security, AFDataFrame &dimCompany, A
 
 AFDataFrame loadProspect(AFDataFrame &s_Prospect, AFDataFrame &batchDate);
 
+AFDataFrame loadFactMarketHistory(AFDataFrame &&s_Market, AFDataFrame &dimSecurity, AFDataFrame &dimDate,
+                                  AFDataFrame &financial);
+
+AFDataFrame loadDimTrade(AFDataFrame &&s_Trade, AFDataFrame &&s_TradeHistory, AFDataFrame &statusType,
+                         AFDataFrame &tradeType, AFDataFrame &dimAccount, AFDataFrame &dimSecurity,
+                         AFDataFrame &dimCustomer, AFDataFrame &dimBroker, AFDataFrame &dimDate, AFDataFrame &dimTime);
+
+AFDataFrame loadFactCashBalances(AFDataFrame &&s_Cash, AFDataFrame &dimAccount, AFDataFrame &dimCustomer,
+                                 AFDataFrame &dimDate);
+
+AFDataFrame loadFactHoldings(AFDataFrame &&s_Holdings, AFDataFrame &dimTrade);
+
+AFDataFrame loadFactWatches(AFDataFrame &&s_Watches, AFDataFrame &dimCustomer, AFDataFrame &dimSecurity,
+                            AFDataFrame &dimDate);
+
+/* Incremental batches apply their CDC records to the warehouse tables in place */
+void updateDimCustomer(AFDataFrame &dimCustomer, AFDataFrame &&s_Customer, AFDataFrame &statusType,
+                       AFDataFrame &taxRate, AFDataFrame &prospect, AFDataFrame &batchDate, unsigned int batchID);
+
+void updateDimAccount(AFDataFrame &dimAccount, AFDataFrame &&s_Account, AFDataFrame &statusType,
+                      AFDataFrame &batchDate, unsigned int batchID);
+
+void updateDimTrade(AFDataFrame &dimTrade, AFDataFrame &&s_Trade, AFDataFrame &statusType, AFDataFrame &tradeType,
+                    AFDataFrame &dimAccount, AFDataFrame &dimSecurity, AFDataFrame &dimCustomer, AFDataFrame &dimBroker,
+                    AFDataFrame &dimDate, AFDataFrame &dimTime, unsigned int batchID);
+
+/* Latest balance of every account in a FactCashBalances table, one row per AccountID. Built once, batches keep it
+ * current so they never go back to the fact table */
+AFDataFrame latestCashBalances(AFDataFrame &fact, AFDataFrame &dimAccount);
+
+void updateFactCashBalances(AFDataFrame &fact, AFDataFrame &balances, AFDataFrame &&s_Cash, AFDataFrame &dimAccount,
+                            AFDataFrame &dimCustomer, AFDataFrame &dimDate, unsigned int batchID);
+
+void updateFactHoldings(AFDataFrame &fact, AFDataFrame &&s_Holdings, AFDataFrame &dimTrade, unsigned int batchID);
+
 #endif //ARRAYFIRE_TPCDI_TPCDI_H
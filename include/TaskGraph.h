@@ -0,0 +1,38 @@
+#ifndef ARRAYFIRE_TPCDI_TASKGRAPH_H
+#define ARRAYFIRE_TPCDI_TASKGRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Runs loaders as soon as the tables they read have been produced. Each task names the tables it reads and
+ * writes and estimates the device memory it needs, either up front or when its inputs are ready and their sizes
+ * known. A ready task starts while the running estimates leave room for it under the budget. A table's release action runs once the last task reading it has finished. Tables a
+ * running task reads or writes are pinned in the MemoryManager */
+class TaskGraph {
+    struct Task {
+        std::string name;
+        std::vector<std::string> inputs;
+        std::vector<std::string> outputs;
+        std::function<size_t()> memory;
+        std::function<void()> work;
+    };
+    std::vector<Task> _tasks;
+    std::unordered_map<std::string, std::function<void()>> _release;
+
+public:
+    void add(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs, size_t memory,
+             std::function<void()> work);
+
+    /* The estimate is taken on the scheduling thread once every input has been produced */
+    void add(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs,
+             std::function<size_t()> memory, std::function<void()> work);
+
+    void release(std::string const &table, std::function<void()> action);
+
+    void run(size_t budget = SIZE_MAX, unsigned int workers = 0);
+};
+
+#endif //ARRAYFIRE_TPCDI_TASKGRAPH_H
@@ -6,6 +6,7 @@
 #include <tuple>
 #include <rapidxml.hpp>
 #include <unordered_map>
+#include <vector>
 #include "Enums.h"
 
 template<typename T>
@@ -24,10 +25,21 @@ namespace Utils {
 
     std::string loadFile(char const *filename);
 
+    std::string readFile(char const *filename);
+
     std::string collect(std::vector<std::string> const &files, bool hasHeader = false);;
 
+    std::vector<std::string> listFiles(std::string const &directory, char const *prefix);
+
+    size_t fileBytes(std::string const &directory, char const *prefix);
+
     af::array where64(af::array const &input);
 
+    /* Validity bitmaps hold one bit per row in u32 words, bit i % 32 of word i / 32 */
+    af::array packBits(af::array const &mask);
+
+    af::array unpackBits(af::array const &bits, dim_t rows);
+
     Column endDate(int length);
 
     inline af::array hflat(af::array const &arr) { return moddims(flat(arr), af::dim4(1, arr.elements())); }
@@ -38,6 +50,7 @@ namespace Utils {
 
     void learnFieldNames(Node *node, StrToInt &tracker, String branch, Node *root);
 
+    /* Lets the MemoryManager free cached buffers or evict cold frames, called between operators */
     void callGC();
 
     std::string flattenCustomerMgmt(char const *directory);
@@ -4,8 +4,17 @@
 #include "AFHashTable.h"
 #include "Utils.h"
 #include "Logger.h"
+#include "ColumnStore.h"
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
 
 typedef unsigned long long ull;
+// Text formatted per task by writeDelimited
+#define CHUNK_BYTES (4llU << 20U)
 
 using namespace BatchFunctions;
 using namespace Utils;
@@ -28,6 +37,7 @@ AFDataFrame& AFDataFrame::operator=(AFDataFrame&& other) noexcept {
 AFDataFrame& AFDataFrame::operator=(AFDataFrame const &other) noexcept {
     _columns = other._columns;
     _nameToCol = other._nameToCol;
+    _colToName = other._colToName;
     _name = other._name;
     return *this;
 }
@@ -59,14 +69,11 @@ void AFDataFrame::insert(Column &&column, unsigned int index, std::string const
 
 void AFDataFrame::remove(unsigned int index) {
     _columns.erase(_columns.begin() + index);
-    _nameToCol.erase(_colToName[index]);
-    _colToName.erase(index);
+    if (_colToName.count(index)) _nameToCol.erase(_colToName.at(index));
+    _colToName.clear();
     for (auto &i : _nameToCol) {
-        if (i.second >= index) {
-            i.second -= 1;
-            _colToName.erase(i.second);
-            _colToName.insert(std::make_pair(i.second, i.first));
-        }
+        if (i.second > index) i.second -= 1;
+        _colToName[i.second] = i.first;
     }
 }
 
@@ -121,8 +128,10 @@ AFDataFrame AFDataFrame::sum(std::string const &col, str_list group_by) const {
     if (agg.type() == STRING || agg.type() == DATE || agg.type() == TIME || agg.type() == DATETIME) {
         throw std::runtime_error("Expected numeric type to aggregate");
     }
+    // Null rows are zeroed so they drop out of the sum
+    auto const valid = agg.isValid();
     if (!group_by.size()) {
-        output.add(Column(af::sum(agg.data(), 1)), "SUM("+col+")");
+        output.add(Column(af::sum(af::select(valid, agg.data(), 0), 1)), "SUM("+col+")");
         return output;
     }
     af::array group_key = _columns[_nameToCol.at(*group_by.begin())].hash();
@@ -131,7 +140,7 @@ AFDataFrame AFDataFrame::sum(std::string const &col, str_list group_by) const {
         if (!j) group_key = group_key ^ (_columns[_nameToCol.at(*i)].hash() << 2);
         else group_key = group_key ^ (_columns[_nameToCol.at(*i)].hash() >> 2);
     }
-    auto to_sum(agg.data());
+    auto to_sum = af::select(valid, agg.data(), 0);
     af::array output_group_idx;
     sort(group_key, output_group_idx, group_key, 1);
     to_sum = to_sum(output_group_idx);
@@ -161,8 +170,13 @@ AFDataFrame AFDataFrame::average(std::string const &col, str_list group_by) cons
     if (agg.type() == STRING || agg.type() == DATE || agg.type() == TIME || agg.type() == DATETIME) {
         throw std::runtime_error("Expected numeric type to aggregate");
     }
+    // Null rows are zeroed and left out of the divisor, a group without valid rows averages to null
+    auto const valid = agg.isValid();
     if (!group_by.size()) {
-        output.add(Column(af::sum(agg.data(), 1) / agg.length()), "AVG("+col+")");
+        auto const n = af::count<ull>(valid);
+        Column average(af::sum(af::select(valid, agg.data(), 0), 1) / (n ? n : 1));
+        if (!n) average.validity(af::constant(0, 1, u32));
+        output.add(std::move(average), "AVG("+col+")");
         return output;
     }
     af::array group_key = _columns[_nameToCol.at(*group_by.begin())].hash();
@@ -171,7 +185,7 @@ AFDataFrame AFDataFrame::average(std::string const &col, str_list group_by) cons
         if (!j) group_key = group_key ^ (_columns[_nameToCol.at(*i)].hash() << 2);
         else group_key = group_key ^ (_columns[_nameToCol.at(*i)].hash() >> 2);
     }
-    auto to_sum(agg.data());
+    auto to_sum = af::select(valid, agg.data(), 0);
     af::array output_group_idx;
     sort(group_key, output_group_idx, group_key, 1);
     to_sum = to_sum(output_group_idx);
@@ -180,14 +194,19 @@ AFDataFrame AFDataFrame::average(std::string const &col, str_list group_by) cons
     auto indexer = where64(join(1, af::constant(1,1,diffe.type()), diffe));
     auto key_count = hflat(where64(join(1, diffe, af::constant(1, 1, diffe.type()))) - indexer + 1); // histogram
 
+    auto const sorted_valid = valid(output_group_idx).as(u64);
     auto loops = af::sum<unsigned long long>(af::max(key_count, 1));
     auto summation = af::constant(0, key_count.dims(), to_sum.type());
+    auto valid_count = af::constant(0, key_count.dims(), u64);
     for (ull i = 0; i < loops; ++i) {
         auto b = i < key_count;
         summation(b) += (to_sum(indexer(b) + i) + 0);
+        valid_count(b) += (sorted_valid(indexer(b) + i) + 0);
     }
 
-    output.add(Column(summation / key_count), "AVG("+col+")");
+    Column average(summation / af::max(valid_count, 1));
+    if (agg.hasNulls()) average.validity(packBits(valid_count > 0));
+    output.add(std::move(average), "AVG("+col+")");
     for (const auto & i : group_by) {
         output.add(_columns[_nameToCol.at(i)].select(output_group_idx), i);
     }
@@ -198,8 +217,9 @@ AFDataFrame AFDataFrame::average(std::string const &col, str_list group_by) cons
 AFDataFrame AFDataFrame::count(std::string const &col, str_list group_by) const {
     AFDataFrame output;
     auto const &agg = _columns[_nameToCol.at(col)];
+    auto const valid = agg.isValid();
     if (!group_by.size()) {
-        output.add(Column(af::array(agg.length(), u64)), "COUNT("+col+")");
+        output.add(Column(af::constant(af::count<ull>(valid), 1, u64)), "COUNT("+col+")");
         return output;
     }
     if (agg.type() == STRING || agg.type() == DATE || agg.type() == TIME || agg.type() == DATETIME) {
@@ -219,6 +239,13 @@ AFDataFrame AFDataFrame::count(std::string const &col, str_list group_by) const
     auto indexer = where64(join(1, af::constant(1,1,diffe.type()), diffe));
     // ArrayFire's histogram may have a small bug that occurs when the integer sets are too big
     auto key_count = hflat(where64(join(1, diffe, af::constant(1,1,diffe.type()))) - indexer + 1); // histogram
+    if (agg.hasNulls()) {
+        // Valid rows per group from a running count over the sorted validity
+        auto const sorted_valid = valid(output_group_idx).as(u64);
+        auto const running = accum(sorted_valid, 1);
+        auto const first = hflat(indexer);
+        key_count = hflat(running(first + key_count - 1)) - hflat(running(first)) + hflat(sorted_valid(first));
+    }
 
     output.add(Column(key_count), "COUNT("+col+")");
     for (const auto & i : group_by) {
@@ -254,7 +281,7 @@ void AFDataFrame::sortBy(unsigned int const col, bool const isAscending) {
     } else {
         for (auto &i : _columns) i = i.select(idx);
     }
-    af::deviceGC();
+    callGC();
 }
 
 void AFDataFrame::sortBy(unsigned int const *columns, unsigned int const size, bool const *isAscending) {
@@ -276,27 +303,377 @@ void AFDataFrame::sortBy(str_list const columns, bool_list const isAscending) {
     sortBy(columns.begin(), columns.size(), isAscending.size() ? isAscending.begin() : nullptr);
 }
 
-AFDataFrame AFDataFrame::equiJoin(AFDataFrame const &rhs, int lhs_column, int rhs_column) const {
-    auto &left = _columns[lhs_column];
-    auto &right = rhs._columns[rhs_column];
-    if (left.type() != right.type()) throw std::runtime_error("Column type mismatch");
-    if (left.isempty() || right.isempty()) return AFDataFrame();
+/* Row order of a multi-word sortable key. Stable sorts from the least significant word up give the lexicographic
+ * order without moving any column */
+static array lexicographicOrder(array const &key) {
+    array sorting;
+    array idx;
+    sort(sorting, idx, key(end, span), 1);
+    array order = idx;
+    for (auto j = (int)key.dims(0) - 2; j >= 0; --j) {
+        sort(sorting, idx, key(j, order), 1);
+        order = order(idx);
+    }
+    return hflat(order);
+}
 
-    auto idx = hashCompare(left.hash(), right.hash());
+/* SCD type 2 history for the whole table. Rows are ordered by business key, effective date and surrogate key without
+ * moving any column; a row followed by one with the same key gets that row's effective date as its EndDate and
+ * stops being current. Needs IsCurrent and EndDate columns */
+void AFDataFrame::applySCD2(std::string const &businessKey, std::string const &effectiveDate,
+                            std::string const &skColumn) {
+    auto const length = rows();
+    if (length < 2) return;
+    auto const &date = _columns[_nameToCol.at(effectiveDate)];
+    array key = _columns[_nameToCol.at(businessKey)].hash(true);
+    auto const words = key.dims(0);
+    key = join(0, key, date.hash(true), _columns[_nameToCol.at(skColumn)].hash(true));
+    auto const order = lexicographicOrder(key);
+
+    // Neighbour pass over the sorted business keys only
+    key = key(seq(words), order);
+    auto const closed = where(allTrue(key(span, seq(0, length - 2)) == key(span, seq(1, length - 1)), 0));
+    if (closed.isempty()) return;
+    array const current = order(closed);
+    array const next = order(closed + 1);
+    _columns[_nameToCol.at("IsCurrent")](current) = 0;
+    _columns[_nameToCol.at("EndDate")](span, current) = (array) date(span, next);
+}
 
-    if (idx.first.isempty()) return AFDataFrame();
+/* Appends a batch of row versions to an SCD type 2 table. The delta is numbered after the largest surrogate key and
+ * its own history resolved with applySCD2; every current row whose business key it touches is then closed on the
+ * earliest delta date of that key. Only current rows are probed, so the table is never re-sorted */
+void AFDataFrame::appendSCD2(AFDataFrame &delta, std::string const &businessKey, std::string const &effectiveDate,
+                             std::string const &skColumn) {
+    if (delta.isEmpty()) return;
+    // An empty table may have no columns yet, the delta then becomes the table under its name
+    if (!isEmpty() && delta.columns() != columns()) throw std::runtime_error("Number of attributes do not match");
+    auto &sk = delta(skColumn);
+    auto const base = isEmpty() ? 0 : max<ull>(_columns[_nameToCol.at(skColumn)].data());
+    sk = Column(range(dim4(1, delta.rows()), 1, u64) + base + 1, sk.type());
+    delta.applySCD2(businessKey, effectiveDate, skColumn);
+    if (isEmpty()) {
+        auto const name = _name.empty() ? delta._name : _name;
+        *this = AFDataFrame(delta);
+        _name = name;
+        return;
+    }
 
-    if (left.type() == STRING) {
-        af::array l = left.index(af::span, idx.first);
-        af::array r = right.index(af::span, idx.second);
-        auto keep = stringComp(left.data(), right.data(), l, r);
-        idx.first = idx.first(keep);
-        idx.second = idx.second(keep);
+    auto &isCurrent = _columns[_nameToCol.at("IsCurrent")];
+    array const current = where(isCurrent.data());
+    if (current.isempty()) {
+        *this = unionize(delta);
+        return;
+    }
+    auto const currentKeys = _columns[_nameToCol.at(businessKey)].select(current);
+    auto const pairs = keyPairs({&currentKeys}, {&delta(businessKey)});
+    if (!pairs.first.isempty()) {
+        // Orders the matches by current row then delta date, the first of each run is the key's earliest version
+        auto const &date = delta(effectiveDate);
+        array const row = hflat(pairs.first).as(u64);
+        auto const order = lexicographicOrder(join(0, row, date.select(pairs.second).hash(true)));
+        array const sorted = row(order);
+        auto first = constant(1, dim4(1, sorted.elements()), b8);
+        if (sorted.elements() > 1) first(0, seq(1, end)) = sorted(0, seq(1, end)) != sorted(0, seq(0, end - 1));
+        array const closed = current(sorted(first));
+        array const earliest = pairs.second(order(first));
+        isCurrent(closed) = 0;
+        _columns[_nameToCol.at("EndDate")](span, closed) = (array) date(span, earliest);
     }
+    *this = unionize(delta);
+}
+
+/* SCD type 1 update on a unique key: delta rows replace the rows holding their key and the rest are appended */
+void AFDataFrame::upsert(AFDataFrame &delta, std::string const &key) {
+    if (delta.isEmpty()) return;
+    if (isEmpty()) {
+        auto const name = _name.empty() ? delta._name : _name;
+        *this = AFDataFrame(delta);
+        _name = name;
+        return;
+    }
+    if (delta.columns() != columns()) throw std::runtime_error("Number of attributes do not match");
+    auto const pairs = keyPairs({&_columns[_nameToCol.at(key)]}, {&delta(key)});
+    if (!pairs.first.isempty()) {
+        auto keep = constant(1, dim4(1, rows()), b8);
+        keep(pairs.first) = 0;
+        *this = select(keep, _name);
+    }
+    *this = unionize(delta);
+}
 
+/* Range window per partition: for every row, the maximum or minimum of value over the rows of its partition dated
+ * within the given number of days up to and including its own date, and the earliest date it was reached on.
+ * Adds them as name and name + "Date" in the current row order.
+ * Window starts come from one sort of the row keys against the keys shifted back by the window; the extremes
+ * from a sparse table built by doubling, answering each row when its window's power-of-two width is reached */
+void AFDataFrame::rangeWindow(std::string const &partition, std::string const &order, std::string const &value,
+                              unsigned int const days, bool const isMaximum, std::string const &name) {
+    auto const &date = _columns[_nameToCol.at(order)];
+    auto const &values = _columns[_nameToCol.at(value)];
+    if (date.type() != DATE) throw std::runtime_error("Expected Date column");
+    if (values.type() == STRING) throw std::runtime_error("Invalid column type");
+    if (!days) throw std::runtime_error("Window must cover at least one day");
+    auto const length = rows();
+    if (!length) return;
+
+    array key = _columns[_nameToCol.at(partition)].hash(true);
+    auto const sorted = lexicographicOrder(join(0, key, date.hash(true)));
+
+    // Partitions numbered in sorted order and packed above the biased day, so one word orders both. The lowest bit
+    // is set on row keys only and breaks ties against the shifted keys, leaving 31 bits for partitions
+    key = key(span, sorted);
+    auto segment = constant(0, dim4(1, length), u64);
+    if (length > 1) {
+        auto const changed = key(span, seq(1, length - 1)) != key(span, seq(0, length - 2));
+        segment(0, seq(1, length - 1)) = anyTrue(changed, 0).as(u64);
+    }
+    segment = accum(segment, 1) << 33;
+    array const day = hflat(date.data()(sorted)).as(s64) + 0x80000000ll;
+    array const rowKey = segment | (day.as(u64) << 1) | 1;
+    array const windowKey = segment | ((day - (days - 1)).as(u64) << 1);
+
+    // Shifted keys are below the row keys of their day, so each lands on its window's first row whatever the sort
+    // does with equal keys
+    array merged;
+    array idx;
+    sort(merged, idx, join(1, windowKey, rowKey), 1);
+    auto const position = range(dim4(1, length), 1, u32);
+    array const start = hflat(where(idx < length)).as(u32) - position;
+
+    // Rows sharing a partition and date all see the same window, ending at the last of them
+    auto run = constant(0, dim4(1, length), u32);
+    if (length > 1) run(0, seq(1, length - 1)) = (diff1(rowKey, 1) != 0).as(u32);
+    run = accum(run, 1);
+    array const last = join(1, diff1(run, 1) != 0, constant(1, dim4(1, 1), b8));
+    array const end = hflat(hflat(where(last)).as(u32)(run));
+    array const width = end - start + 1;
+
+    array const v = hflat(values.data()(sorted));
+    auto const better = [&v, isMaximum](array const &lhs, array const &rhs) {
+        array const l = hflat(lhs);
+        array const r = hflat(rhs);
+        array const a = v(l);
+        array const b = v(r);
+        return af::select(hflat(isMaximum ? b > a : b < a), r, l);
+    };
+
+    // table(i) is the first extreme over the step rows from i
+    array table = position;
+    array best = position;
+    auto const widest = max<unsigned int>(width);
+    for (unsigned int step = 1; step <= widest; step <<= 1U) {
+        auto const answered = width >= step && width < 2 * step;
+        if (anyTrue<bool>(answered)) {
+            best(answered) = better(table(start(answered)), table(end(answered) - step + 1));
+        }
+        if (step > widest / 2) break;
+        table = better(table, table(min(position + step, length - 1)));
+    }
+
+    array const source = sorted(best);
+    array extreme = values.data();
+    extreme(sorted) = hflat(values.data()(source));
+    array reached = date.data();
+    reached(sorted) = hflat(date.data()(source));
+    add(Column(extreme, values.type()), name);
+    add(Column(reached, DATE), name + "Date");
+}
+
+AFDataFrame AFDataFrame::equiJoin(AFDataFrame const &rhs, int lhs_column, int rhs_column) const {
+    auto idx = keyPairs({&_columns[lhs_column]}, {&rhs._columns[rhs_column]});
+    if (idx.first.isempty()) return AFDataFrame();
     return select(idx.first).zip(rhs.select(idx.second));
 }
 
+AFDataFrame AFDataFrame::equiJoin(AFDataFrame const &rhs, str_list lhsKeys, str_list rhsKeys,
+                                  PairFilter const &filter) const {
+    return equiJoin(rhs, lhsKeys, rhsKeys, INNER, filter);
+}
+
+/* Integer keys are their own hash, so equal hashes need no further check */
+static bool isExactHash(Column const &key) {
+    return key.type() != STRING && key.type() != FLOAT && key.type() != DOUBLE;
+}
+
+/* Whether each row pair holds equal values in the two key columns */
+static array keyEqual(Column const &lhs, array const &l, Column const &rhs, array const &r) {
+    if (lhs.type() == STRING) {
+        array const li = lhs.index(span, l);
+        array const ri = rhs.index(span, r);
+        return hflat(stringComp(lhs.data(), rhs.data(), li, ri));
+    }
+    return hflat(lhs.data()(span, l) == rhs.data()(span, r));
+}
+
+/* Whether each lhs key occurs among the rhs keys. The lhs keys probe a hash table of the distinct rhs keys, no row
+ * pairs are scattered */
+static array keyMembership(Column const &lhs, Column const &rhs) {
+    array sorted;
+    array idx;
+    sort(sorted, idx, hflat(lhs.hash()), 1);
+    AFHashTable ht(setUnique(sort(hflat(rhs.hash()), 1), true));
+    auto const hits = hashIntersect(join(0, sorted, idx.as(u64)), ht);
+    auto matched = constant(0, dim4(1, lhs.length()), b8);
+    if (!hits.isempty()) matched(hits.row(1)) = 1;
+    return matched;
+}
+
+/* Join on several key columns at once. SEMI and ANTI keep the lhs rows with and without a match in their order, LEFT
+ * also keeps the unmatched lhs rows with zeros and empty strings on the rhs side and flags them in unmatched when
+ * given. The filter, when given, sees the candidate row pairs before anything is gathered and keeps those it returns
+ * true for, so further conditions never materialise rejected rows */
+AFDataFrame AFDataFrame::equiJoin(AFDataFrame const &rhs, str_list lhsKeys, str_list rhsKeys, JoinType const type,
+                                  PairFilter const &filter, af::array *unmatched) const {
+    if (lhsKeys.size() != rhsKeys.size() || !lhsKeys.size()) throw std::runtime_error("Join keys do not match");
+    std::vector<Column const*> left;
+    std::vector<Column const*> right;
+    for (auto const &key : lhsKeys) left.push_back(&_columns[_nameToCol.at(key)]);
+    for (auto const &key : rhsKeys) right.push_back(&rhs._columns[rhs._nameToCol.at(key)]);
+    auto const length = left[0]->length();
+    if (!length) return AFDataFrame();
+
+    std::pair<array, array> idx;
+    array matched;
+    if (!filter && (type == SEMI || type == ANTI) && left.size() == 1 && isExactHash(*left[0])
+        && left[0]->type() == right[0]->type() && !right[0]->isempty()) {
+        matched = keyMembership(*left[0], *right[0]);
+    } else {
+        idx = keyPairs(left, right);
+        if (filter && !idx.first.isempty()) {
+            array const keep = filter(idx.first, idx.second);
+            idx.first = idx.first(keep);
+            idx.second = idx.second(keep);
+        }
+        matched = constant(0, dim4(1, length), b8);
+        if (!idx.first.isempty()) matched(idx.first) = 1;
+    }
+
+    switch (type) {
+        case SEMI:
+            return select(matched);
+        case ANTI:
+            return select(!matched);
+        case LEFT: {
+            // Unmatched rows point one past the end of rhs, at the default row
+            array const missing = where(!matched).as(u64);
+            auto const defaults = constant(right[0]->length(), dim4(1, missing.elements()), u64);
+            array l = missing;
+            array r = defaults;
+            if (!idx.first.isempty() && !missing.isempty()) {
+                l = join(1, hflat(idx.first).as(u64), missing);
+                r = join(1, hflat(idx.second).as(u64), defaults);
+            } else if (!idx.first.isempty()) {
+                l = hflat(idx.first);
+                r = hflat(idx.second);
+            }
+            if (unmatched) {
+                *unmatched = constant(0, dim4(1, l.elements()), b8);
+                if (!missing.isempty()) (*unmatched)(seq(l.elements() - missing.elements(), end)) = 1;
+            }
+            return select(l).zip(rhs._withDefaultRow().select(r));
+        }
+        default:
+            if (idx.first.isempty()) return AFDataFrame();
+            return select(idx.first).zip(rhs.select(idx.second));
+    }
+}
+
+/* Copy of the frame with one more row of zeros and empty strings, standing in for a missing match. The row is
+ * marked null in every column, strings included, so that unmatched rows of a LEFT join carry nulls on the right */
+AFDataFrame AFDataFrame::_withDefaultRow() const {
+    auto out(*this);
+    for (auto &column : out._columns) {
+        auto padding = column.type() == STRING ?
+                Column(constant(0, 1, u8), join(0, constant(0, 1, u64), constant(1, 1, u64))) :
+                Column(constant(0, dim4(column.dims(0), 1), column.data().type()), column.type());
+        padding.validity(constant(0, 1, u32));
+        column = column.concatenate(padding);
+    }
+    return out;
+}
+
+/* Row pairs whose key columns are all equal. Composite keys are hash-combined into one word for the probe and every
+ * candidate is then checked column by column, a single integer key needs no check */
+std::pair<af::array, af::array> AFDataFrame::keyPairs(std::vector<Column const*> const &lhs,
+                                                      std::vector<Column const*> const &rhs) {
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (lhs[i]->type() != rhs[i]->type()) throw std::runtime_error("Column type mismatch");
+        if (lhs[i]->isempty() || rhs[i]->isempty()) return { af::array(0, u64), af::array(0, u64) };
+    }
+    std::pair<array, array> idx;
+    if (lhs.size() == 1) {
+        idx = hashCompare(*lhs[0], *rhs[0]);
+    } else {
+        array left;
+        array right;
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            left = left.isempty() ? lhs[i]->hash() : (left * 0x100000001b3llU) ^ lhs[i]->hash();
+            right = right.isempty() ? rhs[i]->hash() : (right * 0x100000001b3llU) ^ rhs[i]->hash();
+        }
+        idx = hashCompare(left, right);
+    }
+    if (idx.first.isempty()) return idx;
+
+    if (lhs.size() == 1 && isExactHash(*lhs[0])) return idx;
+    auto keep = constant(1, dim4(1, idx.first.elements()), b8);
+    for (size_t i = 0; i < lhs.size(); ++i) keep = keep && keyEqual(*lhs[i], idx.first, *rhs[i], idx.second);
+    return {idx.first(keep), idx.second(keep)};
+}
+
+/* Interval join for SCD lookups: each row joins the rhs version with an equal key whose [from, to) range holds its
+ * date, so a row yields at most one match. Versions and rows are sorted together by key and date, versions ahead of
+ * rows on the same date, and every row takes the latest version before it within its key. Keys may not be floating
+ * point */
+AFDataFrame AFDataFrame::asOfJoin(AFDataFrame const &rhs, std::string const &key, std::string const &date,
+                                  std::string const &rhsKey, std::string const &from, std::string const &to) const {
+    auto const &lKey = _columns[_nameToCol.at(key)];
+    auto const &rKey = rhs._columns[rhs._nameToCol.at(rhsKey)];
+    auto const &day = _columns[_nameToCol.at(date)];
+    auto const &start = rhs._columns[rhs._nameToCol.at(from)];
+    auto const &until = rhs._columns[rhs._nameToCol.at(to)];
+    if (lKey.type() != rKey.type() || day.type() != start.type() || day.type() != until.type()) {
+        throw std::runtime_error("Column type mismatch");
+    }
+    if (lKey.type() == FLOAT || lKey.type() == DOUBLE) throw std::runtime_error("Invalid key type");
+    if (lKey.isempty() || rKey.isempty()) return AFDataFrame();
+    auto const versions = rKey.length();
+    auto const total = versions + lKey.length();
+
+    // Keys are sorted on whole, strings on all of their words, so a row only ever meets versions of its own key
+    array lWords = lKey.hash(true);
+    array rWords = rKey.hash(true);
+    auto const width = std::max(lWords.dims(0), rWords.dims(0));
+    auto const pad = [width](array const &words) {
+        if (words.dims(0) == width) return words;
+        return join(0, words, constant(0, dim4(width - words.dims(0), words.dims(1)), u64));
+    };
+    lWords = pad(lWords);
+    rWords = pad(rWords);
+    auto const rhsKeys = join(0, rWords, hflat(start.hash(true)), constant(0, dim4(1, versions), u64));
+    auto const lhsKeys = join(0, lWords, hflat(day.hash(true)), constant(1, dim4(1, lKey.length()), u64));
+    auto const sortKey = join(1, rhsKeys, lhsKeys);
+    auto const order = lexicographicOrder(sortKey);
+    array const sorted = sortKey(seq((double)width), order);
+
+    auto starts = constant(1, dim4(1, total), u32);
+    if (total > 1) {
+        starts(0, seq(1, end)) = anyTrue(sorted(span, seq(1, end)) != sorted(span, seq(0, end - 1)), 0).as(u32);
+    }
+    auto const isVersion = order < versions;
+    auto const position = isVersion.as(u32) * (range(dim4(1, total), 1, u32) + 1);
+    array const latest = scanByKey(accum(starts, 1), position, 1, AF_BINARY_MAX);
+    array const probe = !isVersion && latest > 0;
+    if (!anyTrue<bool>(probe)) return AFDataFrame();
+    array const row = order(probe) - versions;
+    array const version = order(latest(probe) - 1);
+
+    // The version must still be in effect
+    array const keep = hflat(until.data()(span, version) > day.data()(span, row));
+    if (!anyTrue<bool>(keep)) return AFDataFrame();
+    return select(row(keep)).zip(rhs.select(version(keep)));
+}
+
 std::pair<af::array, af::array> AFDataFrame::hashCompare(Column const &lhs, Column const &rhs) {
     if (lhs.type() != rhs.type()) throw std::runtime_error("Column type mismatch");
     if (lhs.isempty() || rhs.isempty()) return { af::array(0, u64), af::array(0, u64) };
@@ -382,6 +759,244 @@ void AFDataFrame::flushToHost() {
     for (auto &a : _columns) a.toHost();
 }
 
+void AFDataFrame::toDevice() const {
+    for (auto const &a : _columns) a.toDevice();
+}
+
+size_t AFDataFrame::deviceBytes() const {
+    size_t bytes = 0;
+    for (auto const &a : _columns) bytes += a.deviceBytes();
+    return bytes;
+}
+
+size_t AFDataFrame::bytes() const {
+    size_t bytes = 0;
+    for (auto const &a : _columns) bytes += a.bytes();
+    return bytes;
+}
+
+void AFDataFrame::writeColumnar(std::string const &directory, std::string const &name, bool const compress) const {
+    auto const table = name.empty() ? _name : name;
+    if (table.empty()) throw std::runtime_error("Table needs a name to be written");
+    auto const path = ColumnStore::tableDirectory(directory, table, true);
+    Logger::startTimer("Write " + table);
+    auto const limit = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    std::deque<std::future<void>> pending;
+    ull bytes = 0;
+
+    // Device to host copies stay on this thread, the file writes run alongside the copies of later columns
+    for (unsigned int i = 0; i < _columns.size(); ++i) {
+        if (pending.size() >= limit) {
+            pending.front().get();
+            pending.pop_front();
+        }
+        auto staged = ColumnStore::stage(_columns[i], _colToName.count(i) ? _colToName.at(i) : "", compress);
+        bytes += staged.data.size() + staged.trailer.size();
+        auto file = ColumnStore::columnPath(path, i);
+        pending.emplace_back(std::async(std::launch::async, [staged = std::move(staged), file = std::move(file)]() {
+            ColumnStore::write(file, staged);
+        }));
+    }
+    while (!pending.empty()) {
+        pending.front().get();
+        pending.pop_front();
+    }
+    Logger::annotate(rows(), bytes);
+    Logger::logTime("Write " + table, false);
+}
+
+AFDataFrame AFDataFrame::readColumnar(std::string const &directory, std::string const &name) {
+    auto const path = ColumnStore::tableDirectory(directory, name);
+    auto const count = ColumnStore::columnCount(path);
+    AFDataFrame frame;
+    frame.name(name);
+    Logger::startTimer("Read " + name);
+    for (unsigned int i = 0; i < count; ++i) {
+        std::string column;
+        frame.add(ColumnStore::read(ColumnStore::columnPath(path, i), column), column);
+    }
+    Logger::annotate(frame.rows(), frame.deviceBytes());
+    Logger::logTime("Read " + name, false);
+    return frame;
+}
+
+/* Host copy of a column in the form the text formatter reads. Dates are kept as their YYYYMMDD[HHMMSS] keys */
+struct TextColumn {
+    DataType type;
+    std::vector<char> chars;
+    std::vector<ull> idx;
+    std::vector<ull> keys;
+    std::vector<long long> ints;
+    std::vector<double> reals;
+    std::vector<char> valid;
+};
+
+static TextColumn toText(Column const &column) {
+    TextColumn out;
+    out.type = column.type();
+    auto const rows = column.length();
+    if (column.hasNulls() && rows) {
+        out.valid.resize(rows);
+        column.isValid().host(out.valid.data());
+    }
+    switch (out.type) {
+        case STRING:
+            out.chars.resize(column.data().bytes());
+            out.idx.resize(2 * rows);
+            if (!out.chars.empty()) column.data().host(out.chars.data());
+            if (rows) column.index().host(out.idx.data());
+            break;
+        case DATE: case TIME: case DATETIME:
+            out.keys.resize(rows);
+            if (rows) column.dateKey().as(u64).host(out.keys.data());
+            break;
+        case ULONG:
+            out.keys.resize(rows);
+            if (rows) column.data().as(u64).host(out.keys.data());
+            break;
+        case FLOAT: case DOUBLE:
+            out.reals.resize(rows);
+            if (rows) column.data().as(f64).host(out.reals.data());
+            break;
+        default:
+            out.ints.resize(rows);
+            if (rows) column.data().as(s64).host(out.ints.data());
+    }
+    return out;
+}
+
+static inline char *formatUnsigned(char *out, ull value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) *out++ = digits[--n];
+    return out;
+}
+
+static inline char *formatFixed(char *out, ull value, int const width) {
+    for (int i = width - 1; i >= 0; --i, value /= 10) out[i] = (char)('0' + value % 10);
+    return out + width;
+}
+
+static inline char *formatSigned(char *out, long long const value) {
+    if (value >= 0) return formatUnsigned(out, (ull)value);
+    *out++ = '-';
+    return formatUnsigned(out, 0llU - (ull)value);
+}
+
+/* Up to six decimal places with trailing zeros dropped. Values too large for the fixed point path go
+ * through printf, NaN is written as an empty field */
+static char *formatDecimal(char *out, double const value) {
+    if (std::isnan(value)) return out;
+    if (!(std::fabs(value) < 9e12)) return out + sprintf(out, "%.6g", value);
+    auto const scaled = (ull)std::llround(std::fabs(value) * 1e6);
+    if (value < 0 && scaled) *out++ = '-';
+    out = formatUnsigned(out, scaled / 1000000);
+    auto fraction = scaled % 1000000;
+    if (!fraction) return out;
+    int digits = 6;
+    for (; fraction % 10 == 0; fraction /= 10) --digits;
+    *out++ = '.';
+    return formatFixed(out, fraction, digits);
+}
+
+static inline char *formatDate(char *out, ull const key) {
+    out = formatFixed(out, key / 10000, 4);
+    *out++ = '-';
+    out = formatFixed(out, key / 100 % 100, 2);
+    *out++ = '-';
+    return formatFixed(out, key % 100, 2);
+}
+
+static inline char *formatTime(char *out, ull const key) {
+    out = formatFixed(out, key / 10000, 2);
+    *out++ = ':';
+    out = formatFixed(out, key / 100 % 100, 2);
+    *out++ = ':';
+    return formatFixed(out, key % 100, 2);
+}
+
+static std::string formatRows(std::vector<TextColumn> const &columns, ull const begin, ull const end, char const delim) {
+    std::string out;
+    char field[64];
+    for (auto r = begin; r < end; ++r) {
+        for (size_t c = 0; c < columns.size(); ++c) {
+            auto const &column = columns[c];
+            auto p = field;
+            if (c) out.push_back(delim);
+            if (!column.valid.empty() && !column.valid[r]) continue;
+            switch (column.type) {
+                case STRING: {
+                    auto const length = column.idx[2 * r + 1];
+                    if (length > 1) out.append(column.chars.data() + column.idx[2 * r], length - 1);
+                    continue;
+                }
+                case DATE: p = formatDate(p, column.keys[r]); break;
+                case TIME: p = formatTime(p, column.keys[r]); break;
+                case DATETIME:
+                    p = formatDate(p, column.keys[r] / 1000000);
+                    *p++ = ' ';
+                    p = formatTime(p, column.keys[r] % 1000000);
+                    break;
+                case ULONG: p = formatUnsigned(p, column.keys[r]); break;
+                case FLOAT: case DOUBLE: p = formatDecimal(p, column.reals[r]); break;
+                case BOOL: out.append(column.ints[r] ? "true" : "false"); continue;
+                default: p = formatSigned(p, column.ints[r]);
+            }
+            out.append(field, p - field);
+        }
+        out.push_back('\n');
+    }
+    return out;
+}
+
+void AFDataFrame::writeDelimited(std::string const &path, char const delim) const {
+    Logger::ScopedTimer timer("Write Delimited");
+    std::vector<TextColumn> columns;
+    columns.reserve(_columns.size());
+    for (auto const &column : _columns) columns.emplace_back(toText(column));
+
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "wb"), &fclose);
+    if (!file) throw std::runtime_error("Could not open " + path + " for writing");
+    auto const total = (ull)rows();
+    // Chunks of about CHUNK_BYTES of text, a bounded number of them formatted ahead of the writes
+    ull rowBytes = columns.size();
+    for (auto const &column : columns) {
+        rowBytes += column.type == STRING ? column.chars.size() / std::max(total, 1llU) : 20;
+    }
+    auto const chunk = std::max(CHUNK_BYTES / rowBytes, 1llU);
+    auto const limit = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    std::deque<std::future<std::string>> pending;
+    auto written = true;
+    ull bytes = 0;
+    auto const writeFront = [&]() {
+        auto next = std::move(pending.front());
+        pending.pop_front();
+        auto const text = next.get();
+        written = written && fwrite(text.data(), 1, text.size(), file.get()) == text.size();
+        bytes += text.size();
+    };
+
+    // Chunks are written in row order as they finish
+    try {
+        for (ull begin = 0; begin < total; begin += chunk) {
+            if (pending.size() >= limit) writeFront();
+            auto const end = std::min(begin + chunk, total);
+            pending.emplace_back(std::async(std::launch::async, formatRows, std::cref(columns), begin, end, delim));
+        }
+        while (!pending.empty()) writeFront();
+    } catch (...) {
+        // Chunks still being formatted read the columns, they finish before the error leaves
+        for (auto &task : pending) task.wait();
+        throw;
+    }
+    if (fclose(file.release()) || !written) throw std::runtime_error("Failed to write " + path);
+    Logger::annotate(total, bytes);
+}
+
 void AFDataFrame::clear() {
     _columns.clear();
     _name.clear();
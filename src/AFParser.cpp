@@ -6,6 +6,7 @@
 #include "AFTypes.h"
 #include "Logger.h"
 #include <sstream>
+#include <stdexcept>
 #include <utility>
 using namespace af;
 using namespace BatchFunctions;
@@ -15,23 +16,27 @@ AFParser::AFParser(char const *filename, char const delimiter, bool const hasHea
     Logger::startTimer("CPU Ingestion");
     std::string txt = Utils::loadFile(_filename);
     if (txt.back() != '\n') txt += '\n';
+    Logger::annotate(0, txt.size());
     Logger::logTime("CPU Ingestion", false);
     Logger::startTimer("GPU Ingestion");
     _data = array(txt.size() + 1, txt.c_str()).as(u8);
     txt = "";
     _generateIndexer(hasHeader);
     callGC();
+    Logger::annotate(_length, _data.bytes());
     Logger::logTime("GPU Ingestion", false);
 }
 
 AFParser::AFParser(const std::vector<std::string> &files, char const delimiter, bool const hasHeader) : _delimiter(delimiter) {
     Logger::startTimer("CPU Ingestion");
     auto text = collect(files, hasHeader);
+    Logger::annotate(0, text.size());
     Logger::logTime("CPU Ingestion", false);
     Logger::startTimer("GPU Ingestion");
     _data = array(text.size() + 1, text.c_str()).as(u8);
     _generateIndexer(false);
     callGC();
+    Logger::annotate(_length, _data.bytes());
     Logger::logTime("GPU Ingestion", false);
 }
 
@@ -40,6 +45,7 @@ AFParser::AFParser(std::string const &text, char const delimiter, bool const has
     _data = array(text.size() + 1, text.c_str()).as(u8);
     _generateIndexer(hasHeader);
     callGC();
+    Logger::annotate(_length, _data.bytes());
     Logger::logTime("GPU Ingestion", false);
 }
 
@@ -80,7 +86,10 @@ Column AFParser::parse(int column) const {
     auto idx = _indexer.row(column) + i;
     idx = join(0, idx, (_indexer.row(column + 1) - idx) + 1);
 
-    return Column(numericParse<T>(_data, idx), GetAFType<T>().df_type);
+    af::array valid;
+    Column output(numericParse<T>(_data, idx, &valid), GetAFType<T>().df_type);
+    output.validity(valid);
+    return output;
 }
 template Column AFParser::parse<unsigned char>(int column) const;
 template Column AFParser::parse<short>(int column) const;
@@ -118,6 +127,32 @@ Column AFParser::asTime(int column, bool const isDelimited) const {
     out.toTime(isDelimited);
     return out;
 }
+
+Column AFParser::parse(ParseField const &field) const {
+    switch (field.type) {
+        case INT: return parse<int>(field.column);
+        case SHORT: return parse<short>(field.column);
+        case LONG: return parse<long long>(field.column);
+        case UINT: return parse<unsigned int>(field.column);
+        case UCHAR: return parse<unsigned char>(field.column);
+        case USHORT: return parse<unsigned short>(field.column);
+        case ULONG: return parse<unsigned long long>(field.column);
+        case FLOAT: return parse<float>(field.column);
+        case DOUBLE: return parse<double>(field.column);
+        case STRING: return parse<char*>(field.column);
+        case BOOL: return parse<bool>(field.column);
+        case DATE: return asDate(field.column, true, YYYYMMDD);
+        case TIME: return asTime(field.column, true);
+        case DATETIME: return asDateTime(field.column, YYYYMMDD);
+        default: throw std::runtime_error("Unknown field type");
+    }
+}
+
+std::string AFParser::describe(Schema const &schema) {
+    std::string out;
+    for (auto const &field : schema) out += std::to_string(field.column) + ':' + std::to_string(field.type) + ',';
+    return out;
+}
 Column AFParser::asDate(int column, bool isDelimited, DateFormat inputFormat) const {
     auto out = parse<char*>(column);
     out.toDate(isDelimited, inputFormat);
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "AFDataFrame.h"
+#include "AFHashTable.h"
+#include "AFTypes.h"
+#include "KernelInterface.h"
+#include "SyntheticData.h"
+#include "Utils.h"
+
+/* Micro-benchmarks of the kernels and frame operators on generated data. Every benchmark is run over the grid of row
+ * counts and, where they matter to it, string lengths and key skews. Setup is not timed, each run is synced before
+ * the clock stops */
+
+typedef unsigned long long ull;
+using namespace af;
+using namespace Utils;
+
+namespace {
+    struct Parameters {
+        dim_t rows;
+        unsigned int length;
+        double skew;
+    };
+
+    typedef std::function<void()> Operation;
+
+    struct Benchmark {
+        std::string name;
+        bool usesLength;
+        bool usesSkew;
+        std::function<Operation(Parameters const &)> setup;
+    };
+
+    struct Config {
+        std::vector<dim_t> rows = {1 << 16, 1 << 20};
+        std::vector<unsigned int> lengths = {8, 32};
+        std::vector<double> skews = {0, 1};
+        unsigned int repetitions = 5;
+        std::string filter;
+        std::string output;
+    };
+
+    /* Comma separated numbers */
+    template<typename T>
+    std::vector<T> parseList(char const *text) {
+        std::vector<T> out;
+        char *end;
+        for (auto p = text; *p; p = end + 1) {
+            out.push_back((T)strtod(p, &end));
+            if (*end != ',') break;
+        }
+        return out;
+    }
+
+    /* Sorted hashes over their row numbers, the layout the join kernels take */
+    array sortedKeys(Column const &column) {
+        array sorted;
+        array idx;
+        sort(sorted, idx, hflat(column.hash()), 1);
+        return join(0, sorted, idx.as(u64));
+    }
+
+    template<typename T>
+    Benchmark parseBenchmark() {
+        return {std::string("numericParse<") + GetAFType<T>().str + ">", false, false, [](Parameters const &p) {
+            auto const text = Synthetic::numericText(p.rows, GetAFType<T>().af_type, 0.05);
+            return Operation([text]() {
+                array valid;
+                numericParse<T>(text.data(), text.index(), &valid);
+            });
+        }};
+    }
+
+    std::vector<Benchmark> benchmarks() {
+        std::vector<Benchmark> out = {
+                parseBenchmark<unsigned char>(), parseBenchmark<short>(), parseBenchmark<unsigned short>(),
+                parseBenchmark<int>(), parseBenchmark<unsigned int>(), parseBenchmark<long long>(),
+                parseBenchmark<unsigned long long>(), parseBenchmark<float>(), parseBenchmark<double>()};
+
+        out.push_back({"stringGather", true, false, [](Parameters const &p) {
+            auto const strings = Synthetic::strings(p.rows, p.length);
+            array order;
+            array ignored;
+            sort(ignored, order, randu(p.rows, f32));
+            array const idx = strings.index()(span, order);
+            return Operation([strings, idx]() {
+                auto indexer = idx.copy();
+                stringGather(strings.data(), indexer);
+            });
+        }});
+
+        out.push_back({"stringComp", true, true, [](Parameters const &p) {
+            auto const keys = Synthetic::keys(p.rows, std::max<ull>(p.rows / 8, 1), p.skew);
+            auto const lhs = Synthetic::keyedStrings(keys, p.length);
+            array order;
+            array ignored;
+            sort(ignored, order, randu(p.rows, f32));
+            auto const rhs = lhs.select(order);
+            return Operation([lhs, rhs]() { stringComp(lhs.data(), rhs.data(), lhs.index(), rhs.index()).eval(); });
+        }});
+
+        out.push_back({"fnv1a", true, false, [](Parameters const &p) {
+            auto const strings = Synthetic::strings(p.rows, p.length);
+            return Operation([strings]() { strings.hash().eval(); });
+        }});
+
+        out.push_back({"hashIntersect", false, true, [](Parameters const &p) {
+            auto const bag = sortedKeys(Synthetic::keys(p.rows, p.rows, p.skew));
+            auto const set = Synthetic::keys(std::max<dim_t>(p.rows / 2, 1), p.rows);
+            AFHashTable const table(setUnique(sort(hflat(set.hash()), 1), true));
+            return Operation([bag, table]() { hashIntersect(bag, table); });
+        }});
+
+        // Skewed fact keys against a dimension holding every key once, as the warehouse joins do
+        out.push_back({"joinScatter", false, true, [](Parameters const &p) {
+            auto const distinct = std::max<ull>(p.rows / 4, 1);
+            auto const lhs = sortedKeys(Synthetic::keys(p.rows, distinct, p.skew));
+            auto rhs = sortedKeys(Column(range(dim4(1, distinct), 1, u64), ULONG));
+            rhs = hashIntersect(rhs, AFHashTable(setUnique(lhs.row(0), true)));
+            auto const equals = sum<ull>(diff1(rhs.row(0), 1) > 0) + 1;
+            return Operation([lhs, rhs, equals]() {
+                auto l = lhs;
+                auto r = rhs;
+                joinScatter(l, r, equals);
+            });
+        }});
+
+        out.push_back({"sortBy", false, true, [](Parameters const &p) {
+            AFDataFrame frame;
+            frame.add(Synthetic::keys(p.rows, std::max<ull>(p.rows / 4, 1), p.skew), "K");
+            frame.add(Column(range(dim4(1, p.rows), 1, u64), ULONG), "V");
+            return Operation([frame]() {
+                auto sorted = frame;
+                sorted.sortBy(0);
+            });
+        }});
+
+        out.push_back({"equiJoin", true, true, [](Parameters const &p) {
+            auto const distinct = std::max<ull>(p.rows / 4, 1);
+            AFDataFrame fact;
+            fact.add(Synthetic::keys(p.rows, distinct, p.skew), "FK");
+            fact.add(Column(range(dim4(1, p.rows), 1, u64), ULONG), "V");
+            AFDataFrame dimension;
+            dimension.name("D");
+            Column key(range(dim4(1, distinct), 1, u64), ULONG);
+            dimension.add(Synthetic::keyedStrings(key, p.length), "NAME");
+            dimension.add(std::move(key), "PK");
+            return Operation([fact, dimension]() { fact.equiJoin(dimension, "FK", "PK"); });
+        }});
+        return out;
+    }
+
+    double timeRun(Operation const &operation) {
+        sync();
+        auto const start = std::chrono::steady_clock::now();
+        operation();
+        sync();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run(Benchmark const &benchmark, Parameters const &p, Config const &config, std::ofstream &csv) {
+        auto const operation = benchmark.setup(p);
+        timeRun(operation);
+        std::vector<double> times;
+        for (unsigned int i = 0; i < config.repetitions; ++i) times.push_back(timeRun(operation));
+        std::sort(times.begin(), times.end());
+        auto const median = times[times.size() / 2];
+        auto const rate = (double)p.rows / std::max(times.front(), 1e-9);
+
+        char length[16] = "-";
+        char skew[16] = "-";
+        if (benchmark.usesLength) snprintf(length, sizeof(length), "%u", p.length);
+        if (benchmark.usesSkew) snprintf(skew, sizeof(skew), "%g", p.skew);
+        printf("%-28s %10lld %6s %6s %12.6f %12.6f %14.0f\n", benchmark.name.c_str(), (long long)p.rows, length, skew,
+               times.front(), median, rate);
+        if (csv.is_open()) {
+            csv << benchmark.name << ',' << p.rows << ',' << length << ',' << skew << ',' << config.repetitions << ','
+                << times.front() << ',' << median << ',' << rate << '\n';
+        }
+        deviceGC();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    #if defined(USING_OPENCL)
+        setBackend(AF_BACKEND_OPENCL);
+    #elif defined(USING_CUDA)
+        setBackend(AF_BACKEND_CUDA);
+    #else
+        setBackend(AF_BACKEND_CPU);
+    #endif
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            config.rows = parseList<dim_t>(argv[++i]);
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            config.lengths = parseList<unsigned int>(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            config.skews = parseList<double>(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            config.repetitions = std::max(1u, (unsigned int)std::stoul(argv[++i]));
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            config.filter = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            config.output = argv[++i];
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            setDevice(std::stoi(argv[++i]));
+        } else {
+            printf("Usage: %s [-n rows,...] [-l lengths,...] [-s skews,...] [-r repetitions] [-b name filter] "
+                   "[-o results.csv] [-d device]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.rows.empty() || config.lengths.empty() || config.skews.empty()) {
+        printf("Row, length and skew lists must not be empty\n");
+        return 1;
+    }
+
+    std::ofstream csv;
+    if (!config.output.empty()) {
+        // Runs append to the same file, only the first writes the header
+        csv.open(config.output, std::ios_base::app | std::ios_base::ate);
+        if (csv.tellp() == 0) csv << "Benchmark,Rows,Length,Skew,Repetitions,Min [s],Median [s],Rows/s\n";
+    }
+    Synthetic::seed(0x5eed);
+    printf("%-28s %10s %6s %6s %12s %12s %14s\n", "Benchmark", "Rows", "Length", "Skew", "Min [s]", "Median [s]",
+           "Rows/s");
+    for (auto const &benchmark : benchmarks()) {
+        if (!config.filter.empty() && benchmark.name.find(config.filter) == std::string::npos) continue;
+        auto const lengths = benchmark.usesLength ? config.lengths : std::vector<unsigned int>{0};
+        auto const skews = benchmark.usesSkew ? config.skews : std::vector<double>{0};
+        for (auto const rows : config.rows) {
+            for (auto const length : lengths) {
+                for (auto const skew : skews) run(benchmark, {rows, length, skew}, config, csv);
+            }
+        }
+    }
+    return 0;
+}
@@ -3,9 +3,9 @@
 #include "BatchFunctions.h"
 #include "AFTypes.h"
 #include "KernelInterface.h"
+#include "MemoryManager.h"
 #include <exception>
 #include <cstring>
-#define GC_BUFFER 1000000000
 
 typedef unsigned long long ull;
 
@@ -17,7 +17,7 @@ Column::Column(af::array const &data, DataType const type) : _device(data), _typ
     if (type == STRING) {
         _device = af::flat(_device);
         _generateStringIndex();
-    } else if (type != DATE && type != DATETIME && type != TIME) {
+    } else {
         _device = Utils::hflat(_device);
     }
 }
@@ -25,7 +25,7 @@ Column::Column(af::array &&data, DataType const type) : _device(std::move(data))
     if (type == STRING) {
         _device = af::flat(_device);
         _generateStringIndex();
-    } else if (type != DATE && type != DATETIME && type != TIME) {
+    } else {
         _device = Utils::hflat(_device);
     }
 }
@@ -42,9 +42,8 @@ Column::Column(af::array &&data, af::array &&index) : _device(std::move(data)),
     _device = af::flat(_device);
 }
 Column::Column::Column(Column &&other) noexcept :  _device(std::move(other._device)), _idx(std::move(other._idx)),
-    _type(other._type), _host(other._host), _host_idx(other._host_idx) {
-    other._host_idx = nullptr;
-    other._host = nullptr;
+    _hostData(std::move(other._hostData)), _hostIdx(std::move(other._hostIdx)), _valid(std::move(other._valid)),
+    _type(other._type) {
 }
 Column::Column(Column::Proxy &&data, Column::Proxy &&idx) {
     _device = data;
@@ -65,7 +64,7 @@ Column::Column(Column::Proxy &&data, DataType const type) : _type(type) {
     if (type == STRING) {
         _device = af::flat(_device);
         _generateStringIndex();
-    } else if (type != DATE && type != DATETIME && type != TIME) {
+    } else {
         _device = Utils::hflat(_device);
     }
     _device.eval();
@@ -75,7 +74,7 @@ Column::Column(Column::Proxy const &data, DataType const type) : _type(type) {
     if (type == STRING) {
         _device = af::flat(_device);
         _generateStringIndex();
-    } else if (type != DATE && type != DATETIME && type != TIME) {
+    } else {
         _device = Utils::hflat(_device);
     }
     _device.eval();
@@ -93,11 +92,10 @@ Column::Column(Proxy &&data) : _type(_typeMap.at(std::move(data).type())) {
 Column &Column::operator=(Column &&other) noexcept {
     _device = std::move(other._device);
     _idx = std::move(other._idx);
+    _hostData = std::move(other._hostData);
+    _hostIdx = std::move(other._hostIdx);
+    _valid = std::move(other._valid);
     _type = other._type;
-    _host = other._host;
-    _host_idx = other._host_idx;
-    other._host = nullptr;
-    other._host_idx = nullptr;
     return *this;
 }
 
@@ -133,32 +131,37 @@ af::array Column::_wordHash() const {
     return output;
 }
 
-af::array Column::_dateHash() const {
-    auto mult = af::flip(pow(100Ull, af::range(af::dim4(3), 0, u64)), 0);
-    auto key = batchFunc(mult, _device, BatchFunctions::batchMult);
-    return sum(key, 0).as(u64);
-}
-
-af::array Column::_datetimeHash() const {
-    auto mult = af::flip(pow(100Ull, af::range(af::dim4(6), 0, u64)), 0);
-    auto key = batchFunc(mult, _device, BatchFunctions::batchMult);
-    return sum(key, 0).as(u64);
-}
-
 af::array Column::hash(bool const sortable) const {
+    _reload();
     if (_type == STRING) return sortable ? _wordHash() : _fnv1a();
-    if (_type == DATE) return _dateHash();
-    if (_type == TIME) return _timeHash();
-    if (_type == DATETIME) return _datetimeHash();
+    // Flipping the sign bit keeps dates before the epoch ordered ahead of later ones
+    if (_type == DATE || _type == TIME || _type == DATETIME) return _device.as(s64).as(u64) ^ 0x8000000000000000llU;
     return af::array(_device).as(u64);
 }
 
+af::array Column::dateKey() const {
+    _reload();
+    using namespace af;
+    if (_type == TIME) {
+        auto const t = _device.as(u64);
+        return Utils::hflat(t / 3600 * 10000 + t / 60 % 60 * 100 + t % 60);
+    }
+    if (_type != DATE && _type != DATETIME) throw std::runtime_error("Expected Date, Time or DateTime");
+    auto days = _type == DATE ? _device : floor(_device.as(f64) / 86400).as(s64);
+    auto ymd = _decodeDate(days).as(u64);
+    auto key = ymd.row(0) * 10000 + ymd.row(1) * 100 + ymd.row(2);
+    if (_type == DATE) return key;
+    auto const t = (_device - days.as(s64) * 86400).as(u64);
+    return key * 1000000 + t / 3600 * 10000 + t / 60 % 60 * 100 + t % 60;
+}
+
 af::array Column::operator==(Column const &other) {
+    _reload();
+    other._reload();
     if (_type != other._type) { throw std::runtime_error("Mismatch column type"); }
     if (length() != other.length()) { throw std::runtime_error("Mismatch column length"); }
-    if (_type == STRING || _type == DATE || _type == TIME || _type == DATETIME) {
+    if (_type == STRING) {
         auto b =  hash(false) == other.hash(false);
-        if (_type != STRING) return b;
         if (where(b).isempty()) return b;
         return stringComp(_device, other._device, _idx(af::span, b), other._idx(af::span, b));
     }
@@ -169,12 +172,11 @@ af::array Column::operator!= (Column const &other) { return !(*this == other); }
 
 #define ASSIGN(OP) \
 af::array Column::operator OP(Column const &other) { \
+    _reload(); \
+    other._reload(); \
     if (_type != other._type) { throw std::runtime_error("Mismatch column type"); } \
     if (_type == STRING) { throw std::runtime_error("Invalid column type"); } \
     if (length() != other.length()) { throw std::runtime_error("Mismatch column length"); } \
-    if (_type == DATE || _type == TIME || _type == DATETIME) { \
-        return hash() OP other.hash(); \
-    } \
     return _device OP other._device; \
 }
 ASSIGN(<)
@@ -184,6 +186,8 @@ ASSIGN(>=)
 #undef ASSIGN
 #define ASSIGN(OP) \
 Column Column::operator OP(Column const &other) { \
+    _reload(); \
+    other._reload(); \
     if (_type == STRING || _type == DATE || _type == TIME || _type == DATETIME || \
         other._type == STRING || other._type == DATE || other._type == TIME || other._type == DATETIME) { \
         throw std::runtime_error("Operation on invalid column type"); \
@@ -198,100 +202,158 @@ ASSIGN(/)
 
 
 Column Column::concatenate(Column const &bottom) const {
+    _reload();
+    bottom._reload();
     using namespace BatchFunctions;
     if (_type != bottom._type) throw std::runtime_error("Type mismatch");
-    if (_type == STRING) {
-        auto i = bottom._idx;
-        i.row(0) = af::batchFunc(i.row(0), af::sum(_idx.col(af::end), 0), batchAdd);
-        return Column(join(0, _device, bottom._device), join(1, _idx, i));
-    }
-    return Column(join(1, _device, bottom._device), _type);
+    auto i = bottom._idx;
+    if (_type == STRING) i.row(0) = af::batchFunc(i.row(0), af::sum(_idx.col(af::end), 0), batchAdd);
+    Column output = _type == STRING ? Column(join(0, _device, bottom._device), join(1, _idx, i)) :
+                    Column(join(1, _device, bottom._device), _type);
+    if (hasNulls() || bottom.hasNulls()) output.validity(Utils::packBits(join(1, isValid(), bottom.isValid())));
+    return output;
 }
 
 void Column::toHost() {
-    if (_device.bytes()) {
-        _dimension = _device.dims();
-        auto tmp = malloc(_device.bytes());
-        _device.host(tmp);
-        _host = tmp;
-    }
-    if (_idx.bytes()) {
-        _idxDimension = _idx.dims();
-        auto tmp = (decltype(_host_idx)) malloc(_idx.bytes());
-        _idx.host(tmp);
-        _host_idx = tmp;
-    }
+    if (_hostData || _hostIdx) return;
+    if (_device.bytes()) _hostData = SpillManager::instance().spill(_device);
+    if (_idx.bytes()) _hostIdx = SpillManager::instance().spill(_idx);
     clearDevice();
     af::sync();
 }
 
+void Column::toDevice() const {
+    if (_hostData) _device = SpillManager::instance().load(*_hostData);
+    if (_hostIdx) _idx = SpillManager::instance().load(*_hostIdx);
+    _hostData.reset();
+    _hostIdx.reset();
+}
+
 void Column::clearDevice() {
-    static size_t bytes_cleared = 0;
-    bytes_cleared += _device.bytes();
-    bytes_cleared += _idx.bytes();
+    auto const bytes = _device.bytes() + _idx.bytes();
     _device = af::array();
     _idx = af::array();
-    if (bytes_cleared > GC_BUFFER) af::deviceGC();
+    MemoryManager::instance().released(bytes);
 }
 
 Column Column::select(af::array const &rows) const {
-    if (_type == STRING) {
-        af::array idx = _idx(af::span, rows);
-        return Column(stringGather(_device, idx), idx);
+    _reload();
+    af::array idx = _type == STRING ? _idx(af::span, rows) : _idx;
+    Column output = _type == STRING ? Column(stringGather(_device, idx), idx) : Column(_device(af::span, rows), _type);
+    if (hasNulls()) {
+        // Gathers the selected bits straight from their words, the bitmap is not unpacked
+        af::array const row = af::flat(rows.type() == b8 ? af::where(rows) : rows).as(u64);
+        output.validity(Utils::packBits((_valid(row / 32) >> (row % 32)) & 1));
+    }
+    return output;
+}
+
+void Column::validity(af::array const &bits) {
+    auto const words = (length() + 31) / 32;
+    if (!words || bits.isempty()) {
+        _valid = af::array(0, u32);
+        return;
     }
-    return Column(_device(af::span, rows), _type);
+    if ((size_t)bits.elements() != words) throw std::runtime_error("Validity bitmap does not match the column length");
+    _valid = Utils::hflat(bits);
 }
 
-af::array Column::_dehashDate(af::array const &key, DateFormat const dateFormat) {
+af::array Column::isValid() const {
+    if (!hasNulls()) return af::constant(1, af::dim4(1, length()), b8);
+    return Utils::unpackBits(_valid, length());
+}
+
+af::array Column::_encodeDate(af::array const &key, DateFormat const dateFormat) {
+    using namespace af;
+    array y;
+    array m;
+    array d;
+    auto const k = key.as(s32);
     switch (dateFormat) {
         case YYYYMMDD:
-            return join(0, key / 10000, (key / 100) % 100, key % 100).as(u16);
+            y = k / 10000; m = (k / 100) % 100; d = k % 100;
+            break;
         case YYYYDDMM:
-            return join(0, key / 10000, key % 100, (key / 100) % 100).as(u16);
+            y = k / 10000; m = k % 100; d = (k / 100) % 100;
+            break;
         case MMDDYYYY:
-            return join(0, key % 10000, key / 1000000, (key / 10000) % 100).as(u16);
+            y = k % 10000; m = k / 1000000; d = (k / 10000) % 100;
+            break;
         case DDMMYYYY:
-            return join(0, key % 10000, (key / 10000) % 100, key / 1000000).as(u16);
+            y = k % 10000; m = (k / 10000) % 100; d = k / 1000000;
+            break;
         default:
             throw std::runtime_error("No such date format");
     }
+    // Days from civil date, counting years from March so that leap days fall at the end of the year
+    y = y - (m <= 2).as(s32);
+    auto const era = y / 400;
+    auto const yoe = y - era * 400;
+    auto const doy = (153 * ((m + 9) % 12) + 2) / 5 + d - 1;
+    auto const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (era * 146097 + doe - 719468).as(s32);
+}
+
+af::array Column::_encodeTime(af::array const &key) {
+    auto const k = key.as(s32);
+    return (k / 10000 * 3600 + k / 100 % 100 * 60 + k % 100).as(s32);
+}
+
+af::array Column::_decodeDate(af::array const &days) {
+    using namespace af;
+    auto const z = days.as(s64) + 719468;
+    auto const era = z / 146097;
+    auto const doe = z - era * 146097;
+    auto const yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    auto const doy = doe - (yoe * 365 + yoe / 4 - yoe / 100);
+    auto const mp = (doy * 5 + 2) / 153;
+    auto const d = doy - (mp * 153 + 2) / 5 + 1;
+    auto const m = mp + 3 - (mp >= 10).as(s64) * 12;
+    auto const y = yoe + era * 400 + (m <= 2).as(s64);
+    return join(0, y, m, d);
 }
 
 void Column::toDate(bool const isDelimited, DateFormat const dateFormat) {
+    _reload();
     using namespace af;
     using namespace BatchFunctions;
     if (_type != STRING) throw std::runtime_error("Expected String type");
     if (isDelimited) _device = _device((_device >= '0' && _device <= '9') || _device == 0);
     cast<unsigned int>();
     _type = DATE;
-    _device = _dehashDate(_device, dateFormat);
+    _device = _encodeDate(_device, dateFormat);
     _device.eval();
 }
 
 void Column::toTime(bool const isDelimited) {
+    _reload();
     using namespace af;
     using namespace BatchFunctions;
     if (_type != STRING) throw std::runtime_error("Expected String type");
     if (isDelimited) _device = _device((_device >= '0' && _device <= '9') || _device == 0);
     cast<unsigned int>();
     _type = TIME;
-    _device = _dehashTime(_device);
+    _device = _encodeTime(_device);
     _device.eval();
 }
 
 void Column::toDateTime(DateFormat const dateFormat) {
+    _reload();
     using namespace af;
     using namespace BatchFunctions;
     if (_type != STRING) throw std::runtime_error("Expected String type");
     _device = _device((_device >= '0' && _device <= '9') || _device == 0);
     cast<unsigned long long>();
     _type = DATETIME;
-    _device = join(0, _dehashDate(_device / 1000000, dateFormat), _dehashTime(_device % 1000000));
+    _device = _encodeDate(_device / 1000000, dateFormat).as(s64) * 86400 + _encodeTime(_device % 1000000).as(s64);
     _device.eval();
 }
 
 void Column::printColumn() const {
-    if (_type != STRING) {
+    _reload();
+    if (_type == DATE || _type == TIME || _type == DATETIME) {
+        af_print(dateKey());
+    } else if (_type != STRING) {
         af_print(_device);
     } else {
         printStr(_device);
@@ -299,20 +361,23 @@ void Column::printColumn() const {
 }
 
 void Column::toDate() {
+    _reload();
     if (_type != DATETIME) throw std::runtime_error("Expected DateTime");
     _type = DATE;
-    _device = _device(af::seq(3), af::span);
+    _device = af::floor(_device.as(f64) / 86400).as(s32);
     _device.eval();
 }
 
 void Column::toTime() {
+    _reload();
     if (_type != DATETIME) throw std::runtime_error("Expected DateTime");
     _type = TIME;
-    _device = _device(af::range(af::dim4(3)) + 3, af::span);
+    _device = (_device - af::floor(_device.as(f64) / 86400).as(s64) * 86400).as(s32);
     _device.eval();
 }
 
 Column Column::left(unsigned int length) const {
+    _reload();
     if (type() != STRING) throw std::runtime_error("Expected String");
     if (length == 0) throw std::invalid_argument("Must be > 0");
     auto len = length + 1;
@@ -322,6 +387,7 @@ Column Column::left(unsigned int length) const {
 }
 
 Column Column::right(unsigned int length) const {
+    _reload();
     if (type() != STRING) throw std::runtime_error("Expected String");
     if (length == 0) throw std::invalid_argument("Must be > 0");
     auto len = length + 1;
@@ -333,6 +399,7 @@ Column Column::right(unsigned int length) const {
 }
 
 Column Column::trim(unsigned int start, unsigned int length) const {
+    _reload();
     if (type() != STRING) throw std::runtime_error("Expected String");
     if (start == 0 || length == 0) throw std::invalid_argument("start and length must be > 0");
     auto len = length + 1;
@@ -353,17 +420,19 @@ void Column::_generateStringIndex() {
 
 template<typename T>
 void Column::cast() {
+    _reload();
     using namespace Utils;
     if (_type == DATE || _type == TIME || _type == DATETIME) throw std::runtime_error("Invalid Type");
     if (_type == STRING) {
         _device = _device(_device != ' ');
         _generateStringIndex();
-        _device = numericParse<T>(_device, _idx);
+        _device = numericParse<T>(_device, _idx, &_valid);
     } else {
         _device = _device.as(GetAFType<T>().af_type);
     }
     _type = GetAFType<T>().df_type;
     _idx = af::array(0, u64);
+    validity(af::array(_valid));
 }
 template void Column::cast<unsigned char>();
 template void Column::cast<short>();
@@ -376,6 +445,7 @@ template void Column::cast<float>();
 template void Column::cast<unsigned long long>();
 
 af::array operator==(char const* lhs, Column const &rhs) {
+    rhs._reload();
     if (rhs._type != STRING) throw std::runtime_error("Type mismatch");
     return stringComp(rhs._device, lhs, rhs._idx);
 }
@@ -386,6 +456,7 @@ af::array operator!=(Column const &lhs, char const* rhs) { return !(rhs == lhs);
 #define ASSIGN(OP) \
 template<typename T> \
 af::array operator OP(T const &lhs, Column const &rhs) { \
+    rhs._reload(); \
     if (rhs._type == STRING || rhs._type == DATE || rhs._type == TIME || rhs._type == DATETIME) { \
         throw std::runtime_error("Operation on invalid column type"); \
     } \
@@ -404,6 +475,7 @@ ASSIGN(<)
 #define ASSIGN(OP) \
 template<typename T> \
 Column operator OP(T const &lhs, Column const &rhs) { \
+    rhs._reload(); \
     if (rhs._type == STRING || rhs._type == DATE || rhs._type == TIME || rhs._type == DATETIME) { \
         throw std::runtime_error("Operation on invalid column type"); \
     } \
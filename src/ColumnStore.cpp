@@ -0,0 +1,153 @@
+#include "ColumnStore.h"
+#include "SpillManager.h"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <exception>
+
+namespace fs = boost::filesystem;
+static char const FOOTER_MAGIC[8] = "AFCOLFT";
+
+static bool isIntegral(DataType const type) {
+    switch (type) {
+        case INT: case SHORT: case LONG: case UINT: case UCHAR: case USHORT: case ULONG: case DATE: case TIME:
+        case DATETIME: return true;
+        default: return false;
+    }
+}
+
+static af::dtype narrowest(uint64_t const range, size_t &width) {
+    if (range <= UINT8_MAX) { width = 1; return u8; }
+    if (range <= UINT16_MAX) { width = 2; return u16; }
+    if (range <= UINT32_MAX) { width = 4; return u32; }
+    width = 8;
+    return u64;
+}
+
+ColumnStore::Staged ColumnStore::stage(Column const &column, std::string const &name, bool const compress) {
+    Footer footer;
+    memset(&footer, 0, sizeof(footer));
+    strncpy(footer.name, name.c_str(), sizeof(footer.name) - 1);
+    memcpy(footer.magic, FOOTER_MAGIC, sizeof(footer.magic));
+    footer.dataType = column.type();
+    footer.length = column.length();
+    af::array data = column.data();
+    footer.afType = data.type();
+    footer.compression = NONE;
+
+    if (footer.length && (column.type() == FLOAT || column.type() == DOUBLE)) {
+        footer.min.f = af::min<double>(data);
+        footer.max.f = af::max<double>(data);
+    } else if (footer.length && column.type() == ULONG) {
+        footer.min.u = af::min<unsigned long long>(data);
+        footer.max.u = af::max<unsigned long long>(data);
+    } else if (footer.length && isIntegral(column.type())) {
+        footer.min.i = af::min<long long>(data);
+        footer.max.i = af::max<long long>(data);
+    }
+
+    // Frame of reference: store the offsets from the minimum in the narrowest unsigned type that holds the range
+    if (compress && footer.length && isIntegral(column.type())) {
+        size_t width;
+        auto const stored = narrowest(footer.max.u - footer.min.u, width);
+        if (width < data.bytes() / data.elements()) {
+            data = data.type() == u64 ? data - footer.min.u : data.as(s64) - footer.min.i;
+            data = data.as(stored);
+            footer.compression = FRAME_OF_REFERENCE;
+        }
+    }
+
+    Staged staged;
+    staged.dims = data.dims();
+    staged.type = data.type();
+    staged.data.resize(data.bytes());
+    if (data.bytes()) data.host(staged.data.data());
+    if (column.type() == STRING) {
+        auto const &index = column.index();
+        footer.indexBytes = index.bytes();
+        staged.trailer.resize(footer.indexBytes);
+        if (footer.indexBytes) index.host(staged.trailer.data());
+    }
+    if (column.hasNulls()) {
+        footer.flags |= HAS_VALIDITY;
+        auto const &valid = column.validity();
+        auto const offset = staged.trailer.size();
+        staged.trailer.resize(offset + valid.bytes());
+        valid.host(staged.trailer.data() + offset);
+    }
+    auto const offset = staged.trailer.size();
+    staged.trailer.resize(offset + sizeof(footer));
+    memcpy(staged.trailer.data() + offset, &footer, sizeof(footer));
+    return staged;
+}
+
+void ColumnStore::write(std::string const &path, Staged const &staged) {
+    SpillManager::writeFile(path, staged.data.data(), staged.dims, staged.type, staged.data.size(),
+                            staged.trailer.data(), staged.trailer.size());
+}
+
+/* One bit per row in u32 words, see Utils::packBits */
+static size_t validityBytes(ColumnStore::Footer const &footer) {
+    return footer.flags & ColumnStore::HAS_VALIDITY ? (footer.length + 31) / 32 * sizeof(uint32_t) : 0;
+}
+
+Column ColumnStore::read(std::string const &path, std::string &name) {
+    SpillManager::FileHeader header;
+    size_t length;
+    auto const map = (unsigned char const *)SpillManager::mapFile(path, header, length);
+    auto const trailer = SpillManager::headerSize + header.bytes;
+    Footer footer;
+    if (length >= trailer + sizeof(footer)) memcpy(&footer, map + length - sizeof(footer), sizeof(footer));
+    if (length < trailer + sizeof(footer) || memcmp(footer.magic, FOOTER_MAGIC, sizeof(footer.magic)) ||
+        length != trailer + footer.indexBytes + validityBytes(footer) + sizeof(footer)) {
+        SpillManager::unmapFile((void *)map, length);
+        throw std::runtime_error(path + " has no column footer");
+    }
+    footer.name[sizeof(footer.name) - 1] = 0;
+    name = footer.name;
+
+    // Buffers go straight from the mapped file to the device
+    af::array data(af::dim4(header.dims[0], header.dims[1], header.dims[2], header.dims[3]), (af::dtype)header.type);
+    if (header.bytes) data.write(map + SpillManager::headerSize, header.bytes);
+    af::array index;
+    if (footer.dataType == STRING) {
+        index = af::array(af::dim4(2, footer.length), u64);
+        if (footer.indexBytes) index.write(map + trailer, footer.indexBytes);
+    }
+    af::array valid;
+    if (validityBytes(footer)) {
+        valid = af::array(validityBytes(footer) / sizeof(uint32_t), u32);
+        valid.write(map + trailer + footer.indexBytes, validityBytes(footer));
+    }
+    SpillManager::unmapFile((void *)map, length);
+
+    if (footer.compression == FRAME_OF_REFERENCE) {
+        data = footer.afType == u64 ? data.as(u64) + footer.min.u : data.as(s64) + footer.min.i;
+        data = data.as((af::dtype)footer.afType);
+    }
+    auto column = footer.dataType == STRING ? Column(std::move(data), std::move(index)) :
+                  Column(std::move(data), (DataType)footer.dataType);
+    if (!valid.isempty()) column.validity(valid);
+    return column;
+}
+
+std::string ColumnStore::tableDirectory(std::string const &directory, std::string const &table, bool const create) {
+    auto const path = fs::path(directory) / table;
+    if (create) {
+        // Stale column files from an earlier, wider version of the table would be picked up by columnCount
+        fs::remove_all(path);
+        fs::create_directories(path);
+    } else if (!fs::is_directory(path)) {
+        throw std::runtime_error("No stored table at " + path.string());
+    }
+    return path.string();
+}
+
+std::string ColumnStore::columnPath(std::string const &table, unsigned int const column) {
+    return (fs::path(table) / (std::to_string(column) + ".afcol")).string();
+}
+
+unsigned int ColumnStore::columnCount(std::string const &table) {
+    unsigned int count = 0;
+    while (fs::exists(columnPath(table, count))) ++count;
+    return count;
+}
@@ -3,6 +3,10 @@
 #include "Utils.h"
 #include "KernelInterface.h"
 #include "Logger.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <thread>
 
 typedef unsigned long long ull;
 using namespace af;
@@ -11,121 +15,210 @@ using namespace Utils;
 FinwireParser::FinwireParser(std::vector<std::string> const &files) {
      Logger::startTimer("CPU Ingestion");
     auto text = collect(files);
-    if (text.back() != '\n') text += '\n';
      Logger::logTime("CPU Ingestion", false);
 
      Logger::startTimer("GPU Ingestion");
+    _upload(text);
+     Logger::logTime("GPU Ingestion", false);
+}
+
+void FinwireParser::_upload(std::string &text) {
+    if (text.empty() || text.back() != '\n') text += '\n';
     _data = array(text.size(), text.c_str()).as(u8);
     auto row_end = hflat(where64(_data == '\n'));
     auto row_start = join(1, constant(0, 1, row_end.type()), row_end.cols(0, end - 1) + 1);
     _indexer = join(0, row_start, row_end);
     _data.eval();
     _indexer.eval();
-     Logger::logTime("GPU Ingestion", false);
 }
 
-af::array FinwireParser::filterRowsByCategory(const FinwireParser::RecordType &type) const {
-    using namespace BatchFunctions;
-    Logger::startTimer("Finwire Separation");
-    auto recType = af::batchFunc(_indexer.row(0), range(dim4(3), 0, u64) + 15, batchAdd);
-    af::array tmp = _data(recType);
-    tmp = moddims(tmp, dim4(3, tmp.elements() / 3));
-    tmp = allTrue(batchFunc(tmp, array(3, _search[type]), batchEqual), 0);
-    Logger::logTime("Finwire Separation", false);
-    return tmp;
+static AFDataFrame mergeInOrder(std::vector<AFDataFrame> &frames) {
+    // Merging neighbours pairwise copies each row O(log n) times rather than once per file
+    while (frames.size() > 1) {
+        std::vector<AFDataFrame> merged;
+        for (size_t i = 0; i + 1 < frames.size(); i += 2) {
+            if (frames[i].isEmpty()) merged.emplace_back(std::move(frames[i + 1]));
+            else if (frames[i + 1].isEmpty()) merged.emplace_back(std::move(frames[i]));
+            else merged.emplace_back(frames[i].unionize(frames[i + 1]));
+        }
+        if (frames.size() % 2) merged.emplace_back(std::move(frames.back()));
+        frames = std::move(merged);
+    }
+    return frames.empty() ? AFDataFrame() : std::move(frames.front());
 }
 
-AFDataFrame FinwireParser::extractCmp() const {
-    callGC();
-    AFDataFrame output;
-    int const *lengths = _CMPLengths;
-    print("CMP");
+Finwire FinwireParser::parseFiles(std::vector<std::string> const &files) {
+    // Workers start on the default device with no open span, they decode on the caller's device under its span
+    auto const device = getDevice();
+    auto const parent = Logger::currentSpan();
+    auto const decode = [&files, device, parent](size_t i) {
+        Logger::inheritSpan(parent);
+        setDevice(device);
+        auto text = loadFile(files[i].c_str());
+        FinwireParser parser;
+        parser._upload(text);
+        text = std::string();
+        return parser.extractData();
+    };
+    auto const limit = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    std::vector<AFDataFrame> cmp;
+    std::vector<AFDataFrame> fin;
+    std::vector<AFDataFrame> sec;
+    std::deque<std::future<Finwire>> pending;
+    size_t next = 0;
+
+    // Files are read and decoded independently, results are collected in file order to keep PTS ordering
+    while (next < files.size() || !pending.empty()) {
+        while (next < files.size() && pending.size() < limit) {
+            pending.emplace_back(std::async(std::launch::async, decode, next++));
+        }
+        auto finwire = pending.front().get();
+        pending.pop_front();
+        cmp.emplace_back(std::move(finwire.company));
+        fin.emplace_back(std::move(finwire.financial));
+        sec.emplace_back(std::move(finwire.security));
+    }
 
-    auto rows = filterRowsByCategory(CMP);
+    return Finwire(mergeInOrder(cmp), mergeInOrder(fin), mergeInOrder(sec));
+}
 
-    af::array start = _indexer(0, rows);
-    for (int i = 0; *lengths; ++lengths, ++i) {
-        if (i == 3) output.add(parse<unsigned long long>(start, *lengths));
-        else output.add(_extract(start, *lengths, CMP));
+std::string FinwireParser::describe() {
+    FinwireParser const parser;
+    std::string out;
+    auto const add = [&out](char const *record, Field const *fields, size_t const count) {
+        out += record;
+        for (size_t i = 0; i < count; ++i) {
+            out += ',' + std::to_string(fields[i].length) + ':' + std::to_string(fields[i].type);
+        }
+        out += ';';
+    };
+    add("FIN", parser._FINFields, sizeof(parser._FINFields) / sizeof(Field));
+    add("CMP", parser._CMPFields, sizeof(parser._CMPFields) / sizeof(Field));
+    add("SEC", parser._SECFields, sizeof(parser._SECFields) / sizeof(Field));
+    return out;
+}
 
-        if (i == 0) output(i).toDateTime(YYYYMMDD);
-        else if (i == 7) output(i).toDate(false, YYYYMMDD);
-        start += *lengths;
-    }
-    return output;
+af::array FinwireParser::_classify() const {
+    Logger::startTimer("Finwire Separation");
+    // The first letter of the record type ('F', 'C' or 'S') is enough to tell the three apart
+    af::array out = _data(_indexer.row(0) + 15);
+    out = hflat(out);
+    out.eval();
+    Logger::logTime("Finwire Separation", false);
+    return out;
 }
 
-AFDataFrame FinwireParser::extractFin() const {
-    callGC();
-    AFDataFrame output;
-    int const *lengths = _FINLengths;
-    print("FIN");
+af::array FinwireParser::filterRowsByCategory(const FinwireParser::RecordType &type) const {
+    return hflat(where64(_classify() == _search[type][0]));
+}
 
-    auto rows = filterRowsByCategory(FIN);
+static Column emptyColumn(af::dtype const type, DataType const dataType) {
+    if (dataType == STRING) return Column(array(0, u8), array(2, 0, u64));
+    return Column(array(dim4(1, 0), type), dataType);
+}
 
-    af::array start = _indexer(0, rows);
-    for (int i = 0; *lengths; ++lengths, ++i) {
-        if (i == 2) output.add(parse<unsigned short>(start, *lengths));
-        else if (i == 3) output.add(parse<unsigned char>(start, *lengths));
-        else if (i >= 6 && i < 14) output.add(parse<double>(start, *lengths));
-        else if (i >= 14 && i < 16) output.add(parse<unsigned long long>(start, *lengths));
-        else output.add(_extract(start, *lengths, FIN));
+af::array FinwireParser::_fieldIndexer(array const &start, Field const *fields, std::vector<int> const &group) const {
+    using namespace BatchFunctions;
+    auto const rows = start.elements();
+    auto const n = group.size();
+    std::vector<ull> offsets(n, 0);
+    std::vector<ull> lengths(n);
+    for (size_t g = 0; g < n; ++g) {
+        for (int i = 0; i < group[g]; ++i) offsets[g] += fields[i].length;
+        lengths[g] = fields[group[g]].length + 1;
+    }
+    // Field-major layout: every row of the first field, followed by every row of the next one
+    auto idx = batchFunc(moddims(start, dim4(rows)), array(dim4(1, n), offsets.data()), batchAdd);
+    auto len = tile(array(dim4(1, n), lengths.data()), dim4(rows));
+    for (size_t g = 0; g < n; ++g) {
+        if (fields[group[g]].type != CIK) continue;
+        // A company is referred to either by its 10 digit CIK or by its 60 character name
+        len.col(g) = flat((_data(idx.col(g)) != '0') * 50 + 11).as(u64);
+    }
+    return join(0, hflat(idx), hflat(len));
+}
 
-        if (i == 0) output(i).toDateTime(YYYYMMDD);
-        else if (i == 4 || i == 5) output(i).toDate(false, YYYYMMDD);
+void FinwireParser::_gatherStrings(array const &start, Field const *fields, std::vector<int> const &group,
+                                   std::vector<Column> &output) const {
+    if (group.empty()) return;
+    auto const rows = start.elements();
+    auto idx = _fieldIndexer(start, fields, group);
+    auto data = stringGather(_data, idx, true);
+
+    // Every field occupies a contiguous slice of the gathered buffer
+    std::vector<ull> bounds(group.size() + 1, data.elements());
+    array(idx(0, range(dim4(group.size()), 0, u64) * rows)).host(bounds.data());
+    for (size_t g = 0; g < group.size(); ++g) {
+        array d = data(seq((double)bounds[g], (double)bounds[g + 1] - 1));
+        array i = idx.cols(g * rows, (g + 1) * rows - 1);
+        i.row(0) -= bounds[g];
+        output[group[g]] = Column(std::move(d), std::move(i));
+    }
+}
 
-        start += *lengths;
+template<typename T>
+void FinwireParser::_parseNumbers(array const &start, Field const *fields, std::vector<int> const &group,
+                                  std::vector<Column> &output) const {
+    if (group.empty()) return;
+    auto const rows = start.elements();
+    auto numbers = numericParse<T>(_data, _fieldIndexer(start, fields, group));
+    for (size_t g = 0; g < group.size(); ++g) {
+        output[group[g]] = Column(numbers.cols(g * rows, (g + 1) * rows - 1));
     }
-    return output;
 }
 
-AFDataFrame FinwireParser::extractSec() const {
+AFDataFrame FinwireParser::_decode(array const &rows, Field const *fields) const {
     callGC();
-    print("SEC");
-    int const *lengths = _SECLengths;
     AFDataFrame output;
-
-    auto rows = filterRowsByCategory(SEC);
     af::array start = _indexer(0, rows);
-
-    for (int i = 0; *lengths; ++lengths, ++i) {
-        if (i == 7) output.add(parse<unsigned long long>(start, *lengths));
-        else if (i == 10) output.add(parse<double>(start, *lengths));
-        else output.add(_extract(start, *lengths, SEC));
-
-        if (i == 0) output(i).toDateTime(YYYYMMDD);
-        else if (i == 8 || i == 9) output(i).toDate(false, YYYYMMDD);
-        start += *lengths;
+    start = hflat(start);
+
+    // Text, name-or-CIK and date fields share one gather, numeric fields one parse per type
+    std::vector<int> groups[F64 + 1];
+    int count = 0;
+    for (; fields[count].length; ++count) groups[fields[count].type >= U8 ? fields[count].type : STR].push_back(count);
+
+    if (start.isempty()) {
+        af::dtype const types[] = {u8, u8, s32, s64, u8, u16, u64, f64};
+        DataType const dataTypes[] = {STRING, STRING, DATE, DATETIME, UCHAR, USHORT, ULONG, DOUBLE};
+        for (int i = 0; i < count; ++i) output.add(emptyColumn(types[fields[i].type], dataTypes[fields[i].type]));
+        return output;
     }
 
+    std::vector<Column> columns((size_t)count, emptyColumn(u8, STRING));
+    _gatherStrings(start, fields, groups[STR], columns);
+    _parseNumbers<unsigned char>(start, fields, groups[U8], columns);
+    _parseNumbers<unsigned short>(start, fields, groups[U16], columns);
+    _parseNumbers<unsigned long long>(start, fields, groups[U64], columns);
+    _parseNumbers<double>(start, fields, groups[F64], columns);
+
+    for (int i = 0; i < count; ++i) {
+        if (fields[i].type == YMD_HMS) columns[i].toDateTime(YYYYMMDD);
+        else if (fields[i].type == YMD) columns[i].toDate(false, YYYYMMDD);
+        output.add(std::move(columns[i]));
+    }
     return output;
 }
 
-template<typename T>
-Column FinwireParser::parse(const af::array& start, unsigned int const length) const {
-    auto idx = join(0,start, constant(length + 1, start.dims(), start.type()));
-    return Column(numericParse<T>(_data, idx));
-}
-template Column FinwireParser::parse<unsigned char>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<short>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<unsigned short>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<int>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<unsigned int>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<long long>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<double>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<float>(const af::array& start, unsigned int const length) const;
-template Column FinwireParser::parse<unsigned long long>(const af::array& start, unsigned int const length) const;
-template<> Column FinwireParser::parse<char*>(const af::array& start, unsigned int const length) const {
-    if (!length) return Column(array(0, u8), array(0,u64));
-    auto idx = join(0,start, constant(length + 1, start.dims(), start.type()));
-    auto out = stringGather(_data, idx);
-    return Column(std::move(out), std::move(idx));
-}
-Column FinwireParser::_extract(const array &start, unsigned int const length, FinwireParser::RecordType const &type) const {
-    if (type != CMP && length == 60) {
-        auto idx = join(0, start, hflat((_data(start) != '0') * 50 + 11).as(start.type()));
-        auto out = stringGather(_data, idx);
-        return Column(std::move(out), std::move(idx));
-    }
-    return parse<char*>(start, length);
+AFDataFrame FinwireParser::extractCmp() const {
+    print("CMP");
+    return _decode(filterRowsByCategory(CMP), _CMPFields);
+}
+
+AFDataFrame FinwireParser::extractFin() const {
+    print("FIN");
+    return _decode(filterRowsByCategory(FIN), _FINFields);
+}
+
+AFDataFrame FinwireParser::extractSec() const {
+    print("SEC");
+    return _decode(filterRowsByCategory(SEC), _SECFields);
+}
+
+Finwire FinwireParser::extractData() const {
+    auto const type = _classify();
+    auto cmp = _decode(hflat(where64(type == _search[CMP][0])), _CMPFields);
+    auto fin = _decode(hflat(where64(type == _search[FIN][0])), _FINFields);
+    auto sec = _decode(hflat(where64(type == _search[SEC][0])), _SECFields);
+    return Finwire(std::move(cmp), std::move(fin), std::move(sec));
 }
@@ -63,6 +63,67 @@ void launchStringGather(unsigned char *output, unsigned long long const *idx, un
     }
 }
 
+void launchStringTrim(unsigned long long *idx, unsigned char const *input, unsigned long long rows) {
+    for (ull i = 0; i < rows; ++i) {
+        auto const start = idx[2 * i];
+        auto len = idx[2 * i + 1];
+        while (len > 1 && input[start + len - 2] == ' ') --len;
+        idx[2 * i + 1] = len;
+    }
+}
+
+/* Parts hold the start and length of the country, area, local and extension strings of each row */
+static inline ull phoneLength(ull const *parts) {
+    ull const country = parts[1] > 1 ? parts[1] - 1 : 0;
+    ull const area = parts[3] > 1 ? parts[3] - 1 : 0;
+    ull const local = parts[5] > 1 ? parts[5] - 1 : 0;
+    ull const ext = parts[7] > 1 ? parts[7] - 1 : 0;
+    if (!local) return 1;
+    ull len = local + 1;
+    if (area) len += area + 3 + (country ? country + 2 : 0);
+    if (ext) len += ext + 1;
+    return len;
+}
+
+void launchPhoneLength(unsigned long long *idx, unsigned long long const *parts, unsigned long long rows) {
+    for (ull i = 0; i < rows; ++i) idx[2 * i + 1] = phoneLength(parts + 8 * i);
+}
+
+void launchPhoneFormat(unsigned char *output, unsigned long long const *idx, unsigned char const *input,
+                       unsigned long long const *parts, unsigned long long rows) {
+    for (ull i = 0; i < rows; ++i) {
+        auto const p = parts + 8 * i;
+        auto out = output + idx[2 * i];
+        ull const country = p[1] > 1 ? p[1] - 1 : 0;
+        ull const area = p[3] > 1 ? p[3] - 1 : 0;
+        ull const local = p[5] > 1 ? p[5] - 1 : 0;
+        ull const ext = p[7] > 1 ? p[7] - 1 : 0;
+        if (local && area) {
+            if (country) {
+                *out++ = '+';
+                memcpy(out, input + p[0], country);
+                out += country;
+                *out++ = ' ';
+            }
+            *out++ = '(';
+            memcpy(out, input + p[2], area);
+            out += area;
+            *out++ = ')';
+            *out++ = ' ';
+        }
+        if (local) {
+            memcpy(out, input + p[4], local);
+            out += local;
+            if (ext) {
+                *out++ = ' ';
+                memcpy(out, input + p[6], ext);
+                out += ext;
+            }
+        }
+        *out = 0;
+    }
+}
+
 void launchStringComp(bool *output, unsigned char const *left, unsigned char const *right,
                       unsigned long long const *l_idx, unsigned long long const *r_idx, unsigned int const *mask, unsigned long long rows) {
     for (int j = 0; j < rows; ++j) {
@@ -107,16 +168,20 @@ template<> inline long long convert<long long>(const unsigned char *start) {
 }
 
 template<typename T>
-void launchNumericParse(T *output, unsigned long long const * idx, unsigned char const *input,
-                        unsigned long long rows) {
+void launchNumericParse(T *output, unsigned int *valid, unsigned int *nulls, unsigned long long const * idx,
+                        unsigned char const *input, unsigned long long rows) {
     for (ull i = 0; i < rows; ++i) {
         auto start = input + idx[2 * i];
         output[i] = *(start) == '\0' ? 0 : convert<T>(start);
+        if (!valid) continue;
+        if (idx[2 * i + 1] > 1) valid[i >> 5] |= 1u << (i & 31);
+        else *nulls = 1;
     }
 }
 
 #define PARSER(TYPE) \
-template void launchNumericParse<TYPE>(TYPE *output, ull const * idx, unsigned char const *input, ull const rows);
+template void launchNumericParse<TYPE>(TYPE *output, unsigned int *valid, unsigned int *nulls, ull const * idx, \
+                                       unsigned char const *input, ull const rows);
 
 PARSER(unsigned char)
 PARSER(float)
@@ -61,7 +61,8 @@ __global__ static void join_scatter(ull const *l_idx, ull const *r_idx, ull cons
 
 }
 template<typename T>
-__global__ static void parser(T *output, ull const *idx, unsigned char const *input, ull const rows) {
+__global__ static void parser(T *output, unsigned int *valid, unsigned int *nulls, ull const *idx,
+                              unsigned char const *input, ull const rows) {
     ull const id = (ull)blockIdx.x * (ull)blockDim.x + (ull)threadIdx.x;
     if (id < rows) {
         long long const s = idx[2 * id];
@@ -80,6 +81,8 @@ __global__ static void parser(T *output, ull const *idx, unsigned char const *in
         }
 
         output[id] = number * (!neg - neg);
+        if (valid && len > 0) atomicOr(valid + (id >> 5), 1u << (id & 31));
+        else if (valid) atomicOr(nulls, 1u);
     }
 }
 
@@ -95,6 +98,75 @@ __global__ static void string_gather(unsigned char *output, ull const *idx, unsi
     }
 }
 
+__global__ static void string_trim(ull *idx, unsigned char const *input, ull const rows) {
+    ull const r = (ull)blockIdx.x * (ull)blockDim.x + (ull)threadIdx.x;
+    if (r < rows) {
+        ull const start = idx[2 * r];
+        ull len = idx[2 * r + 1];
+        while (len > 1 && input[start + len - 2] == ' ') --len;
+        idx[2 * r + 1] = len;
+    }
+}
+
+/* Parts hold the start and length of the country, area, local and extension strings of each row */
+__device__ static ull phone_part(ull const *parts, int const k) {
+    return parts[2 * k + 1] > 1 ? parts[2 * k + 1] - 1 : 0;
+}
+
+__global__ static void phone_length(ull *idx, ull const *parts, ull const rows) {
+    ull const r = (ull)blockIdx.x * (ull)blockDim.x + (ull)threadIdx.x;
+    if (r < rows) {
+        ull const *p = parts + 8 * r;
+        ull const country = phone_part(p, 0);
+        ull const area = phone_part(p, 1);
+        ull const local = phone_part(p, 2);
+        ull const ext = phone_part(p, 3);
+        ull len = 1;
+        if (local) {
+            len += local;
+            if (area) len += area + 3 + (country ? country + 2 : 0);
+            if (ext) len += ext + 1;
+        }
+        idx[2 * r + 1] = len;
+    }
+}
+
+__global__ static void phone_format(unsigned char *output, ull const *idx, unsigned char const *input,
+                                    ull const *parts, ull const rows) {
+    ull const r = (ull)blockIdx.x * (ull)blockDim.x + (ull)threadIdx.x;
+    if (r < rows) {
+        ull const *p = parts + 8 * r;
+        unsigned char *out = output + idx[2 * r];
+        ull const country = phone_part(p, 0);
+        ull const area = phone_part(p, 1);
+        ull const local = phone_part(p, 2);
+        ull const ext = phone_part(p, 3);
+        if (local && area) {
+            if (country) {
+                *out++ = '+';
+                memcpy(out, input + p[0], country);
+                out += country;
+                *out++ = ' ';
+            }
+            *out++ = '(';
+            memcpy(out, input + p[2], area);
+            out += area;
+            *out++ = ')';
+            *out++ = ' ';
+        }
+        if (local) {
+            memcpy(out, input + p[4], local);
+            out += local;
+            if (ext) {
+                *out++ = ' ';
+                memcpy(out, input + p[6], ext);
+                out += ext;
+            }
+        }
+        *out = 0;
+    }
+}
+
 __global__ static void str_cmp(bool *output, unsigned char const *left, unsigned char const *right,
                                ull const *l_idx, ull const *r_idx, unsigned int const * mask, ull const rows) {
     ull const id = (ull)blockIdx.x * (ull)blockDim.x + (ull)threadIdx.x;
@@ -200,19 +272,21 @@ void lauchJoinScatter(ull const *l_idx, ull const *r_idx, ull const *l_cnt, ull
 }
 
 template<typename T>
-void launchNumericParse(T *output, ull const * idx, unsigned char const *input, ull const rows) {
+void launchNumericParse(T *output, unsigned int *valid, unsigned int *nulls, ull const * idx,
+                        unsigned char const *input, ull const rows) {
     auto layout = blockFinder(rows);
     dim3 grid(layout.first, 1, 1);
     dim3 block(layout.second, 1, 1);
 
     cudaProfilerStart();
-    parser<T><<<grid, block>>>(output, idx, input, rows);
+    parser<T><<<grid, block>>>(output, valid, nulls, idx, input, rows);
     cudaDeviceSynchronize();
     cudaProfilerStop();
 
 }
 #define PARSER(TYPE) \
-template void launchNumericParse<TYPE>(TYPE *output, ull const * idx, unsigned char const *input, ull const rows);
+template void launchNumericParse<TYPE>(TYPE *output, unsigned int *valid, unsigned int *nulls, ull const * idx, \
+                                       unsigned char const *input, ull const rows);
 
 PARSER(unsigned char)
 PARSER(float)
@@ -239,6 +313,43 @@ void launchStringGather(unsigned char *output, ull const *idx, unsigned char con
     cudaProfilerStop();
 }
 
+void launchStringTrim(ull *idx, unsigned char const *input, ull const rows) {
+    auto layout = blockFinder(rows);
+
+    dim3 grid(layout.first, 1, 1);
+    dim3 block(layout.second, 1, 1);
+
+    cudaProfilerStart();
+    string_trim<<<grid, block>>>(idx, input, rows);
+    cudaDeviceSynchronize();
+    cudaProfilerStop();
+}
+
+void launchPhoneLength(ull *idx, ull const *parts, ull const rows) {
+    auto layout = blockFinder(rows);
+
+    dim3 grid(layout.first, 1, 1);
+    dim3 block(layout.second, 1, 1);
+
+    cudaProfilerStart();
+    phone_length<<<grid, block>>>(idx, parts, rows);
+    cudaDeviceSynchronize();
+    cudaProfilerStop();
+}
+
+void launchPhoneFormat(unsigned char *output, ull const *idx, unsigned char const *input, ull const *parts,
+                       ull const rows) {
+    auto layout = blockFinder(rows);
+
+    dim3 grid(layout.first, 1, 1);
+    dim3 block(layout.second, 1, 1);
+
+    cudaProfilerStart();
+    phone_format<<<grid, block>>>(output, idx, input, parts, rows);
+    cudaDeviceSynchronize();
+    cudaProfilerStop();
+}
+
 void launchStringComp(bool *output, unsigned char const *left, unsigned char const *right,
                       ull const *l_idx, ull const *r_idx, unsigned int const *mask, ull const rows) {
     auto layout = blockFinder(rows);
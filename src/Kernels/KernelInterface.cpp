@@ -34,6 +34,7 @@ af::array crossIntersect(af::array const &bag, af::array const &set) {
     result.unlock();
 #endif
     af::array out = bag(span, result);
+    Logger::annotate(bag_size, (bag_size + set_size) * sizeof(ull), out.dims(1));
     Logger::logTime("NL Bag Set", false);
     return out;
 }
@@ -69,6 +70,7 @@ af::array hashIntersect(af::array const &bag, AFHashTable const &ht) {
 
     af::array out = bag(span, result);
     out.eval();
+    Logger::annotate(bag_size, bag_size * sizeof(ull) + ht.getValues().bytes(), out.dims(1));
     Logger::logTime("Hash Bag Set", false);
 
     return out;
@@ -78,7 +80,9 @@ void joinScatter(af::array &lhs, af::array &rhs, ull const equals) {
     using namespace af;
     using namespace Utils;
 
-    Logger::startTimer("Join Scatter");
+    Logger::ScopedTimer timer("Join Scatter");
+    auto const input_rows = lhs.dims(1) + rhs.dims(1);
+    auto const input_bytes = lhs.bytes() + rhs.bytes();
 
     auto diffe = diff1(lhs.row(0), 1) > 0;
 
@@ -93,11 +97,17 @@ void joinScatter(af::array &lhs, af::array &rhs, ull const equals) {
 
     auto output_pos = right_count * left_count;
     auto output_size = sum<ull>(output_pos);
+    if (!output_size) {
+        lhs = array(dim4(1, 0), lhs.type());
+        rhs = array(dim4(1, 0), rhs.type());
+        Logger::annotate(input_rows, input_bytes, 0);
+        return;
+    }
     output_pos = (output_pos.elements() == 1) ? constant(0, 1, output_pos.type())
                                               : scan(output_pos, 1, AF_BINARY_ADD, false);
-#ifdef USING_AF
     array left_out(1, output_size, u64);
     array right_out(1, output_size, u64);
+#ifdef USING_AF
     auto i = range(dim4(1, equals * left_max * right_max), 1, u64);
     auto j = i / right_max % left_max;
     auto k = i % right_max;
@@ -109,8 +119,6 @@ void joinScatter(af::array &lhs, af::array &rhs, ull const equals) {
     left_out(idx) = left_idx(i) + j(b);
     right_out(idx) = right_idx(i) + k(b);
 #else
-    array left_out(1, output_size, u64);
-    array right_out(1, output_size, u64);
     auto idx_l = left_idx.device<ull>();
     auto idx_r = right_idx.device<ull>();
     auto count_l = left_count.device<ull>();
@@ -134,12 +142,32 @@ void joinScatter(af::array &lhs, af::array &rhs, ull const equals) {
     rhs = rhs(1, right_out);
     lhs.eval();
     rhs.eval();
-    Logger::logTime("Join Scatter", false);
+    Logger::annotate(input_rows, input_bytes + 2 * output_size * sizeof(ull), output_size);
 }
 
-af::array stringGather(af::array const &input, af::array &indexer) {
+af::array stringGather(af::array const &input, af::array &indexer, bool const rtrim) {
     using namespace af;
     Logger::startTimer("String Gather");
+    if (rtrim && !indexer.isempty()) {
+        // Drop trailing padding from the lengths so only the true strings are gathered
+        #ifdef USING_AF
+        for (ull i = sum<ull>(max(indexer.row(1), 1)); i > 1; --i) {
+            auto b = indexer.row(1) == i;
+            b(b) = flat(input(indexer(0, b) + i - 2) == ' ');
+            indexer(1, b) = i - 1;
+        }
+        #else
+        auto idx_ptr = indexer.device<ull>();
+        auto in_ptr = input.device<unsigned char>();
+        af::sync();
+
+        launchStringTrim(idx_ptr, in_ptr, indexer.elements() / 2);
+
+        input.unlock();
+        indexer.unlock();
+        #endif
+        indexer.eval();
+    }
     indexer = join(0, indexer, indexer.elements() < 3 ?
                                constant(0, 1, indexer.type()) :
                                scan(indexer.row(1), 1, AF_BINARY_ADD, false));
@@ -173,15 +201,96 @@ af::array stringGather(af::array const &input, af::array &indexer) {
     indexer = join(0, indexer.row(2), indexer.row(1));
     indexer.eval();
 
+    // Every gathered character is read once and written once
+    Logger::annotate(rows, 2 * out_size + indexer.bytes(), rows);
     Logger::logTime("String Gather", false);
     return output;
 }
 
+af::array phoneFormat(af::array const &input, af::array const &parts, af::array &indexer) {
+    using namespace af;
+    Logger::startTimer("Phone Format");
+    auto const rows = parts.elements() / 8;
+    indexer = constant(0, dim4(2, rows), u64);
+    if (!rows) {
+        Logger::logTime("Phone Format", false);
+        return array(0, u8);
+    }
+    #ifdef USING_AF
+    auto const part = [&parts](int const k) { return max(parts.row(2 * k + 1), 1) - 1; };
+    auto const country = part(0);
+    auto const area = part(1);
+    auto const local = part(2);
+    auto const ext = part(3);
+    auto const hasLocal = local > 0;
+    auto const hasArea = area > 0 && hasLocal;
+    auto const hasCountry = country > 0 && hasArea;
+    auto const hasExt = ext > 0 && hasLocal;
+    indexer.row(1) = hasCountry * (country + 2) + hasArea * (area + 3) + local + hasExt * (ext + 1) + 1;
+    #else
+    auto idx_ptr = indexer.device<ull>();
+    auto parts_ptr = parts.device<ull>();
+    af::sync();
+
+    launchPhoneLength(idx_ptr, parts_ptr, rows);
+
+    indexer.unlock();
+    parts.unlock();
+    #endif
+    if (rows > 1) indexer.row(0) = scan(indexer.row(1), 1, AF_BINARY_ADD, false);
+    indexer.eval();
+
+    auto const out_size = sum<ull>(indexer.row(1));
+    auto output = constant(0, out_size, u8);
+    #ifdef USING_AF
+    array pos = indexer.row(0);
+    auto const copy = [&](array const &length, array const &mask, int const k, int const offset) {
+        auto const loops = sum<ull>(max(length * mask, 1));
+        for (ull i = 0; i < loops; ++i) {
+            auto const b = mask && length > i;
+            output(pos(b) + offset + i) = input(parts(2 * k, b) + i);
+        }
+    };
+    output(pos(hasCountry)) = '+';
+    copy(country, hasCountry, 0, 1);
+    output(pos(hasCountry) + country(hasCountry) + 1) = ' ';
+    pos += hasCountry * (country + 2);
+    output(pos(hasArea)) = '(';
+    copy(area, hasArea, 1, 1);
+    output(pos(hasArea) + area(hasArea) + 1) = ')';
+    output(pos(hasArea) + area(hasArea) + 2) = ' ';
+    pos += hasArea * (area + 3);
+    copy(local, hasLocal, 2, 0);
+    pos += local;
+    output(pos(hasExt)) = ' ';
+    copy(ext, hasExt, 3, 1);
+    output.eval();
+    #else
+    auto out_ptr = output.device<unsigned char>();
+    auto in_ptr = input.device<unsigned char>();
+    idx_ptr = indexer.device<ull>();
+    parts_ptr = parts.device<ull>();
+    af::sync();
+
+    launchPhoneFormat(out_ptr, idx_ptr, in_ptr, parts_ptr, rows);
+
+    output.unlock();
+    input.unlock();
+    indexer.unlock();
+    parts.unlock();
+    #endif
+    Logger::annotate(rows, parts.bytes() + out_size, rows);
+    Logger::logTime("Phone Format", false);
+    return output;
+}
+
 af::array stringComp(af::array const &lhs, af::array const &rhs, af::array const &l_idx, af::array const &r_idx) {
     using namespace af;
     Logger::startTimer("String Comparison");
     if (l_idx.elements() != r_idx.elements()) throw std::runtime_error("Expected columns with same length");
     auto out = l_idx.row(1) == r_idx.row(1);
+    // Only rows of equal length get their characters compared, counting them takes a reduction
+    auto const compared = Logger::exactCounts() ? 2 * sum<ull>(l_idx.row(1) * out) : lhs.bytes() + rhs.bytes();
     #ifdef USING_AF
     auto loops = sum<ull>(max(l_idx(1, out)));
     for (ull i = 0; i < loops; ++i) {
@@ -207,6 +316,8 @@ af::array stringComp(af::array const &lhs, af::array const &rhs, af::array const
     r_idx.unlock();
     #endif
     out.eval();
+    Logger::annotate(l_idx.elements() / 2, l_idx.bytes() + r_idx.bytes() + compared,
+                     Logger::exactCounts() ? count<ull>(out) : Logger::UNCOUNTED);
     Logger::logTime("String Comparison", false);
     return out;
 }
@@ -216,6 +327,7 @@ af::array stringComp(af::array const &lhs, char const *rhs, af::array const &l_i
     Logger::startTimer("String Comparison");
     auto loops = strlen(rhs) + 1;
     auto out = l_idx.row(1) == loops;
+    auto const compared = (Logger::exactCounts() ? count<ull>(out) : l_idx.elements() / 2) * loops;
     #ifdef USING_AF
     for (ull i = 0; i < loops; ++i) {
         out(out) = out(out) && Utils::hflat(lhs(l_idx(0, out) + i) == rhs[i]);
@@ -238,20 +350,33 @@ af::array stringComp(af::array const &lhs, char const *rhs, af::array const &l_i
     #endif
 
     out.eval();
+    Logger::annotate(l_idx.elements() / 2, l_idx.bytes() + compared,
+                     Logger::exactCounts() ? count<ull>(out) : Logger::UNCOUNTED);
     Logger::logTime("String Comparison", false);
     return out;
 }
 
 template<typename T>
-af::array numericParse(af::array const &input, af::array const &indexer) {
+af::array numericParse(af::array const &input, af::array const &indexer, af::array *valid) {
     using namespace af;
     using namespace Utils;
     Logger::startTimer("Numeric Parse");
     auto const loops = sum<ull>(max(indexer.row(1), 1)) - 1;
     auto const rows = indexer.elements() / 2;
     auto output = constant(0, dim4(1, rows), GetAFType<T>().af_type);
-    if (!loops) return output;
+    if (valid) *valid = constant(0, (rows + 31) / 32, u32);
+    // Characters of every field are read once, the whole text buffer unless counted exactly
+    auto const characters = Logger::exactCounts() ? sum<ull>(indexer.row(1)) : input.bytes();
+    Logger::annotate(rows, characters + indexer.bytes() + output.bytes(), rows);
+    if (!loops) {
+        Logger::logTime("Numeric Parse", false);
+        return output;
+    }
     #ifdef USING_AF
+    if (valid) {
+        auto const present = indexer.row(1) > 1;
+        *valid = allTrue<bool>(present) ? array(0, u32) : packBits(present);
+    }
     auto dec = constant(0, output.dims(), u8);
     auto frac = constant(0, output.dims(), b8);
     auto neg = frac;
@@ -268,29 +393,30 @@ af::array numericParse(af::array const &input, af::array const &indexer) {
     }
     output = output * (!neg - neg);
     output.eval();
-
-    digit_idx = array();
-    len = array();
-    dec = array();
-    neg = array();
-    callGC();
     #else
+    // The kernel raises nulls on its first empty field, a bitmap without one is dropped
+    auto nulls = constant(0, 1, u32);
     auto out_ptr = output.template device<T>();
+    auto valid_ptr = valid ? valid->device<unsigned int>() : nullptr;
+    auto nulls_ptr = valid ? nulls.device<unsigned int>() : nullptr;
     auto idx_ptr = indexer.device<ull>();
     auto in_ptr = input.device<unsigned char>();
     af::sync();
-    launchNumericParse<T>(out_ptr, idx_ptr, in_ptr, rows);
+    launchNumericParse<T>(out_ptr, valid_ptr, nulls_ptr, idx_ptr, in_ptr, rows);
     output.unlock();
+    if (valid) valid->unlock();
+    if (valid) nulls.unlock();
     input.unlock();
     indexer.unlock();
     output.eval();
+    if (valid && !nulls.scalar<unsigned int>()) *valid = array(0, u32);
     #endif
     Logger::logTime("Numeric Parse", false);
     return output;
 }
 
 #define PARSER(TYPE) \
-template af::array numericParse<TYPE>(af::array const &input, af::array const &indexer);
+template af::array numericParse<TYPE>(af::array const &input, af::array const &indexer, af::array *valid);
 
 PARSER(unsigned char)
 PARSER(float)
@@ -350,6 +350,134 @@ void launchStringGather(unsigned char *output, ull const *idx, unsigned char con
     Logger::pauseCollection();
 }
 
+void launchStringTrim(ull *idx, unsigned char const *input, ull const rows) {
+    Logger::startCollection();
+    char msg[128];
+    // Get OpenCL context from memory buffer and create a Queue
+    cl_context context = get_context((cl_mem)idx);
+    cl_command_queue queue = create_queue(context);
+
+    cl_program program = build_program(context);
+    cl_kernel kernel = create_kernel(program, "string_trim");
+
+    cl_int err = CL_SUCCESS;
+    int arg = 0;
+    // Set input parameters for the kernel
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &idx);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &input);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg, sizeof(ull), &rows);
+    if (err != CL_SUCCESS) {
+        ARG_FAIL:
+        sprintf(msg, "OpenCL Error(%d): Failed to set kernel arguments\n", err);
+        throw std::runtime_error(msg);
+    }
+    // Set launch configuration parameters and launch kernel
+    auto layout = blockFinder(rows);
+    size_t local = layout.second;
+    size_t global = layout.first;
+    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Failed to enqueue kernel\n", err);
+        throw std::runtime_error(msg);
+    }
+
+    err = clFinish(queue);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Kernel failed to finish\n", err);
+        throw std::runtime_error(msg);
+    }
+    Logger::pauseCollection();
+}
+
+void launchPhoneLength(ull *idx, ull const *parts, ull const rows) {
+    Logger::startCollection();
+    char msg[128];
+    // Get OpenCL context from memory buffer and create a Queue
+    cl_context context = get_context((cl_mem)idx);
+    cl_command_queue queue = create_queue(context);
+
+    cl_program program = build_program(context);
+    cl_kernel kernel = create_kernel(program, "phone_length");
+
+    cl_int err = CL_SUCCESS;
+    int arg = 0;
+    // Set input parameters for the kernel
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &idx);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &parts);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg, sizeof(ull), &rows);
+    if (err != CL_SUCCESS) {
+        ARG_FAIL:
+        sprintf(msg, "OpenCL Error(%d): Failed to set kernel arguments\n", err);
+        throw std::runtime_error(msg);
+    }
+    // Set launch configuration parameters and launch kernel
+    auto layout = blockFinder(rows);
+    size_t local = layout.second;
+    size_t global = layout.first;
+    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Failed to enqueue kernel\n", err);
+        throw std::runtime_error(msg);
+    }
+
+    err = clFinish(queue);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Kernel failed to finish\n", err);
+        throw std::runtime_error(msg);
+    }
+    Logger::pauseCollection();
+}
+
+void launchPhoneFormat(unsigned char *output, ull const *idx, unsigned char const *input, ull const *parts,
+                       ull const rows) {
+    Logger::startCollection();
+    char msg[128];
+    // Get OpenCL context from memory buffer and create a Queue
+    cl_context context = get_context((cl_mem)output);
+    cl_command_queue queue = create_queue(context);
+
+    cl_program program = build_program(context);
+    cl_kernel kernel = create_kernel(program, "phone_format");
+
+    cl_int err = CL_SUCCESS;
+    int arg = 0;
+    // Set input parameters for the kernel
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &output);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &idx);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &input);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &parts);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg, sizeof(ull), &rows);
+    if (err != CL_SUCCESS) {
+        ARG_FAIL:
+        sprintf(msg, "OpenCL Error(%d): Failed to set kernel arguments\n", err);
+        throw std::runtime_error(msg);
+    }
+    // Set launch configuration parameters and launch kernel
+    auto layout = blockFinder(rows);
+    size_t local = layout.second;
+    size_t global = layout.first;
+    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Failed to enqueue kernel\n", err);
+        throw std::runtime_error(msg);
+    }
+
+    err = clFinish(queue);
+    if (err != CL_SUCCESS) {
+        sprintf(msg, "OpenCL Error(%d): Kernel failed to finish\n", err);
+        throw std::runtime_error(msg);
+    }
+    Logger::pauseCollection();
+}
+
 void launchStringComp(bool *output, unsigned char const *left, unsigned char const *right, unsigned long long const *l_idx,
                       unsigned long long const *r_idx, unsigned int const *mask, unsigned long long const rows) {
     Logger::startCollection();
@@ -452,7 +580,8 @@ void launchStringComp(bool *output, unsigned char const *left, unsigned char con
 }
 
 template<typename T>
-void launchNumericParse(T *output, ull const * idx, unsigned char const *input, ull const rows) {
+void launchNumericParse(T *output, unsigned int *valid, unsigned int *nulls, ull const * idx,
+                        unsigned char const *input, ull const rows) {
     Logger::startCollection();
     char msg[128];
     // Get OpenCL context from memory buffer and create a Queue
@@ -471,6 +600,10 @@ void launchNumericParse(T *output, ull const * idx, unsigned char const *input,
     // Set input parameters for the kernel
     err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &output);
     if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &valid);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
+    err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &nulls);
+    if (err != CL_SUCCESS) goto ARG_FAIL;
     err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &idx);
     if (err != CL_SUCCESS) goto ARG_FAIL;
     err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &input);
@@ -501,7 +634,8 @@ void launchNumericParse(T *output, ull const * idx, unsigned char const *input,
 }
 
 #define PARSER(TYPE) \
-template void launchNumericParse<TYPE>(TYPE *output, ull const * idx, unsigned char const *input, ull const rows);
+template void launchNumericParse<TYPE>(TYPE *output, unsigned int *valid, unsigned int *nulls, ull const * idx, \
+                                       unsigned char const *input, ull const rows);
 
 PARSER(unsigned char)
 PARSER(float)
@@ -61,6 +61,71 @@ __kernel void string_gather(__global uchar *output, __global ulong const *idx, _
     }
 }
 
+__kernel void string_trim(__global ulong *idx, __global uchar const *input, ulong const rows) {
+    ulong const r = get_global_id(0);
+    if (r < rows) {
+        ulong const start = idx[2 * r];
+        ulong len = idx[2 * r + 1];
+        while (len > 1 && input[start + len - 2] == ' ') --len;
+        idx[2 * r + 1] = len;
+    }
+}
+
+/* Parts hold the start and length of the country, area, local and extension strings of each row */
+ulong phone_part(__global ulong const *parts, int const k) {
+    return parts[2 * k + 1] > 1 ? parts[2 * k + 1] - 1 : 0;
+}
+
+__kernel void phone_length(__global ulong *idx, __global ulong const *parts, ulong const rows) {
+    ulong const r = get_global_id(0);
+    if (r < rows) {
+        __global ulong const *p = parts + 8 * r;
+        ulong const country = phone_part(p, 0);
+        ulong const area = phone_part(p, 1);
+        ulong const local = phone_part(p, 2);
+        ulong const ext = phone_part(p, 3);
+        ulong len = 1;
+        if (local) {
+            len += local;
+            if (area) len += area + 3 + (country ? country + 2 : 0);
+            if (ext) len += ext + 1;
+        }
+        idx[2 * r + 1] = len;
+    }
+}
+
+__kernel void phone_format(__global uchar *output, __global ulong const *idx, __global uchar const *input,
+        __global ulong const *parts, ulong const rows) {
+    ulong const r = get_global_id(0);
+    if (r < rows) {
+        __global ulong const *p = parts + 8 * r;
+        ulong o = idx[2 * r];
+        ulong const country = phone_part(p, 0);
+        ulong const area = phone_part(p, 1);
+        ulong const local = phone_part(p, 2);
+        ulong const ext = phone_part(p, 3);
+        if (local && area) {
+            if (country) {
+                output[o++] = '+';
+                for (ulong i = 0; i < country; ++i) output[o++] = input[p[0] + i];
+                output[o++] = ' ';
+            }
+            output[o++] = '(';
+            for (ulong i = 0; i < area; ++i) output[o++] = input[p[2] + i];
+            output[o++] = ')';
+            output[o++] = ' ';
+        }
+        if (local) {
+            for (ulong i = 0; i < local; ++i) output[o++] = input[p[4] + i];
+            if (ext) {
+                output[o++] = ' ';
+                for (ulong i = 0; i < ext; ++i) output[o++] = input[p[6] + i];
+            }
+        }
+        output[o] = 0;
+    }
+}
+
 __kernel void str_cmp(__global bool *output, __global uchar const *left, __global uchar const *right,
         __global ulong const *l_idx, __global ulong const *r_idx, __global uint const* mask, ulong const rows) {
     ulong const id = get_global_id(0);
@@ -117,8 +182,8 @@ ulong const size, ulong const rows, ulong const loops) {
 }
 
 #define PARSER_FUNC(TYPE) \
-__kernel void parser_##TYPE (__global TYPE *output, __global ulong const *idx, __global uchar const *input, \
-    ulong const row_num) { \
+__kernel void parser_##TYPE (__global TYPE *output, __global uint *valid, __global uint *nulls, \
+    __global ulong const *idx, __global uchar const *input, ulong const row_num) { \
     ulong const id = get_global_id(0); \
     if (id < row_num) { \
         long const s = idx[2 * id]; \
@@ -136,6 +201,8 @@ __kernel void parser_##TYPE (__global TYPE *output, __global ulong const *idx, _
             number = number * (c * 10 + !c) + b * (digit - '0') / (TYPE)pown(10.0, dec); \
         } \
         output[id] = number * (!neg - neg); \
+        if (valid && len > 0) atomic_or(valid + (id >> 5), 1u << (id & 31)); \
+        else if (valid) atomic_or(nulls, 1u); \
     } \
 }
 
@@ -1,24 +1,124 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
 #include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "Logger.h"
 
+typedef std::chrono::steady_clock Clock;
+typedef unsigned long long ull;
+
+namespace {
+    struct Span {
+        std::string name;
+        ull id;
+        ull parent;
+        unsigned int thread;
+        Clock::time_point start;
+        double duration;
+        ull rows;
+        ull bytes;
+        ull outputRows;
+        ull countedRows;
+    };
+
+    struct Throughput {
+        ull calls;
+        double seconds;
+        ull rows;
+        ull bytes;
+        ull outputRows;
+        ull countedRows;
+    };
+
+    std::mutex timerLock;
+    std::unordered_map<std::string, std::vector<double>> times;
+    std::vector<std::string> order;
+    std::vector<Span> spans;
+    std::unordered_map<std::string, Throughput> operators;
+    std::atomic<ull> spanCount(0);
+    std::atomic<unsigned int> threadCount(0);
+    Clock::time_point const epoch = Clock::now();
+
+    thread_local std::vector<Span> openSpans;
+    thread_local ull inheritedParent = 0;
+    thread_local unsigned int const threadId = threadCount++;
+
+    void addTime(std::string const &name, double const value) {
+        auto &values = times[name];
+        if (values.empty()) order.push_back(name);
+        values.emplace_back(value);
+    }
+
+    void escape(std::ostream &out, std::string const &text) {
+        for (auto const c : text) {
+            if (c == '"' || c == '\\') out << '\\';
+            if ((unsigned char)c >= 0x20) out << c;
+        }
+    }
+}
+
 void Logger::startTimer(std::string const &name) {
     af::sync();
-    _timers[name] = af::timer::start();
+    auto const parent = openSpans.empty() ? inheritedParent : openSpans.back().id;
+    openSpans.push_back({name, ++spanCount, parent, threadId, Clock::now(), 0, 0, 0, 0, 0});
 }
 
 void Logger::logTime(std::string const &name, bool show) {
     af::sync();
-    if (!_timers.count(name)) {
+    auto const end = Clock::now();
+    auto span = openSpans.rbegin();
+    while (span != openSpans.rend() && span->name != name) ++span;
+    if (span == openSpans.rend()) {
         char buffer[128];
         sprintf(buffer, "Timer %s does not exists, start one first", name.c_str());
         std::cerr << buffer << std::endl;
         return;
     }
-    _times[name].emplace_back(af::timer::stop(_timers.at(name)));
-    if (show) std::cout << name << ": " << _times[name].back() << std::endl;
+    auto closed = std::move(*span);
+    openSpans.erase(std::next(span).base(), openSpans.end());
+    closed.duration = std::chrono::duration<double>(end - closed.start).count();
+    if (show) std::cout << name << ": " << closed.duration << std::endl;
+
+    std::lock_guard<std::mutex> guard(timerLock);
+    addTime(name, closed.duration);
+    if (closed.rows || closed.bytes || closed.countedRows) {
+        auto &op = operators[name];
+        ++op.calls;
+        op.seconds += closed.duration;
+        op.rows += closed.rows;
+        op.bytes += closed.bytes;
+        op.outputRows += closed.outputRows;
+        op.countedRows += closed.countedRows;
+    }
+    spans.emplace_back(std::move(closed));
+}
+
+ull Logger::currentSpan() {
+    return openSpans.empty() ? inheritedParent : openSpans.back().id;
+}
+
+void Logger::inheritSpan(ull const parent) {
+    inheritedParent = parent;
+}
+
+void Logger::annotate(ull const rows, ull const bytes, ull const outputRows) {
+    if (openSpans.empty()) return;
+    openSpans.back().rows += rows;
+    openSpans.back().bytes += bytes;
+    if (outputRows == UNCOUNTED) return;
+    openSpans.back().outputRows += outputRows;
+    openSpans.back().countedRows += rows;
+}
+
+void Logger::record(std::string const &name, double const value) {
+    std::lock_guard<std::mutex> guard(timerLock);
+    addTime(name, value);
 }
 
 void Logger::sendToCSV(int const scale) {
@@ -39,13 +139,15 @@ void Logger::sendToCSV(int const scale) {
     #else
     ss << "Scale," << scale << '\n';
     #endif
-    for (auto const &data : _times) {
-        ss << data.first << ',';
-        for (size_t i = 0; i < data.second.size(); ++i) {
-            if (i + 1 == data.second.size()) {
-                ss << data.second[i] << '\n';
+    std::lock_guard<std::mutex> guard(timerLock);
+    for (auto const &name : order) {
+        auto const &data = times.at(name);
+        ss << name << ',';
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (i + 1 == data.size()) {
+                ss << data[i] << '\n';
             } else {
-                ss << data.second[i] << ',';
+                ss << data[i] << ',';
             }
         }
     }
@@ -55,3 +157,48 @@ void Logger::sendToCSV(int const scale) {
     file.close();
 }
 
+void Logger::sendToTrace(std::string const &file) {
+    std::stringstream ss;
+    ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::lock_guard<std::mutex> guard(timerLock);
+    for (size_t i = 0; i < spans.size(); ++i) {
+        auto const &span = spans[i];
+        auto const start = std::chrono::duration<double, std::micro>(span.start - epoch).count();
+        if (i) ss << ',';
+        ss << "\n{\"name\":\"";
+        escape(ss, span.name);
+        ss << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << span.thread << ",\"ts\":" << (ull)start
+           << ",\"dur\":" << (ull)(span.duration * 1e6) << ",\"args\":{\"id\":" << span.id << ",\"parent\":"
+           << span.parent << ",\"rows\":" << span.rows << ",\"bytes\":" << span.bytes;
+        if (span.countedRows) ss << ",\"outputRows\":" << span.outputRows;
+        ss << "}}";
+    }
+    ss << "\n]}\n";
+
+    std::ofstream out(directory() + file);
+    out << ss.str();
+    out.close();
+}
+
+void Logger::sendThroughput(std::string const &file) {
+    std::stringstream ss;
+    ss << "Operator,Calls,Seconds,Rows,Output Rows,Selectivity,Rows/s,MB/s,ns/Row\n";
+    std::lock_guard<std::mutex> guard(timerLock);
+    std::vector<std::string> names;
+    for (auto const &op : operators) names.push_back(op.first);
+    std::sort(names.begin(), names.end());
+    for (auto const &name : names) {
+        auto const &op = operators.at(name);
+        auto const seconds = std::max(op.seconds, 1e-9);
+        ss << name << ',' << op.calls << ',' << op.seconds << ',' << op.rows << ',';
+        if (op.countedRows) ss << op.outputRows << ',' << (double)op.outputRows / (double)op.countedRows;
+        else ss << ',';
+        ss << ',' << (double)op.rows / seconds << ',' << (double)op.bytes / seconds / (1 << 20) << ',';
+        if (op.rows) ss << op.seconds * 1e9 / (double)op.rows;
+        ss << '\n';
+    }
+
+    std::ofstream out(directory() + file);
+    out << ss.str();
+    out.close();
+}
@@ -0,0 +1,143 @@
+#include "MemoryManager.h"
+#include "AFDataFrame.h"
+#include "Logger.h"
+#include <algorithm>
+#include <exception>
+#include <arrayfire.h>
+
+// Cached buffers are freed once they make up this many times the bytes in use
+#define GC_RATIO 8
+
+MemoryManager &MemoryManager::instance() {
+    static MemoryManager manager;
+    return manager;
+}
+
+void MemoryManager::budget(size_t const bytes) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _budget = bytes;
+}
+
+void MemoryManager::track(std::string const &name, AFDataFrame *frame) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto &entry = _frames[name];
+    entry.frame = frame;
+    if (entry.listed) _order.erase(entry.lru);
+    _order.push_front(name);
+    entry.lru = _order.begin();
+    entry.listed = true;
+}
+
+void MemoryManager::untrack(std::string const &name) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto entry = _frames.find(name);
+    if (entry == _frames.end()) return;
+    if (entry->second.listed) _order.erase(entry->second.lru);
+    _frames.erase(entry);
+}
+
+void MemoryManager::pin(std::string const &name) {
+    std::unique_lock<std::mutex> guard(_lock);
+    auto &entry = _frames[name];
+    if (entry.listed) _order.splice(_order.begin(), _order, entry.lru);
+    auto const loading = [this, &name]() {
+        auto const found = _frames.find(name);
+        return found != _frames.end() && found->second.loading;
+    };
+    if (entry.pins++ || !entry.frame) {
+        // A later pin waits for the first one to finish loading the frame
+        _loaded.wait(guard, [&loading]() { return !loading(); });
+        return;
+    }
+    // The first pin reloads the frame without the lock, pinned frames are never evicted meanwhile
+    auto const frame = entry.frame;
+    entry.loading = true;
+    guard.unlock();
+    std::exception_ptr error;
+    try {
+        frame->toDevice();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    guard.lock();
+    auto const loaded = _frames.find(name);
+    if (loaded != _frames.end()) loaded->second.loading = false;
+    _loaded.notify_all();
+    if (error) std::rethrow_exception(error);
+}
+
+void MemoryManager::unpin(std::string const &name) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto entry = _frames.find(name);
+    if (entry != _frames.end() && entry->second.pins) --entry->second.pins;
+}
+
+void MemoryManager::touch(std::string const &name) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto entry = _frames.find(name);
+    if (entry != _frames.end() && entry->second.listed) _order.splice(_order.begin(), _order, entry->second.lru);
+}
+
+size_t MemoryManager::footprint(AFDataFrame const &frame) {
+    std::lock_guard<std::mutex> guard(_lock);
+    return frame.bytes();
+}
+
+void MemoryManager::collect() {
+    size_t alloc;
+    size_t locked;
+    af::deviceMemInfo(&alloc, nullptr, &locked, nullptr);
+    std::lock_guard<std::mutex> guard(_lock);
+    ++_stats.collections;
+    _stats.peakLocked = std::max(_stats.peakLocked, locked);
+    if (alloc > _budget || alloc > locked * GC_RATIO) {
+        _deviceGC();
+        af::deviceMemInfo(&alloc, nullptr, &locked, nullptr);
+    }
+    if (locked > _budget) _evict(locked);
+}
+
+void MemoryManager::released(size_t const bytes) {
+    if ((_released += bytes) <= _releaseThreshold) return;
+    _released = 0;
+    ++_deviceGCs;
+    af::deviceGC();
+}
+
+MemoryManager::Stats MemoryManager::stats() {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto out = _stats;
+    out.deviceGCs = _deviceGCs;
+    return out;
+}
+
+void MemoryManager::report() {
+    auto const out = stats();
+    Logger::record("Memory Collections", (double)out.collections);
+    Logger::record("Memory Device GCs", (double)out.deviceGCs);
+    Logger::record("Memory Evicted Frames", (double)out.evictedFrames);
+    Logger::record("Memory Evicted [MB]", (double)(out.evictedBytes >> 20U));
+    Logger::record("Memory Peak Locked [MB]", (double)(out.peakLocked >> 20U));
+}
+
+void MemoryManager::_deviceGC() {
+    _released = 0;
+    ++_deviceGCs;
+    af::deviceGC();
+}
+
+void MemoryManager::_evict(size_t locked) {
+    size_t evicted = 0;
+    for (auto i = _order.rbegin(); i != _order.rend() && locked > _budget; ++i) {
+        auto const &entry = _frames.at(*i);
+        if (entry.pins || !entry.frame) continue;
+        auto const bytes = entry.frame->deviceBytes();
+        if (!bytes) continue;
+        entry.frame->flushToHost();
+        locked -= std::min(locked, bytes);
+        evicted += bytes;
+        ++_stats.evictedFrames;
+    }
+    _stats.evictedBytes += evicted;
+    if (evicted) _deviceGC();
+}
@@ -0,0 +1,105 @@
+#include "Prefetcher.h"
+#include "Utils.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Prefetcher &Prefetcher::instance() {
+    static Prefetcher prefetcher;
+    return prefetcher;
+}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+    if (_thread.joinable()) _thread.join();
+}
+
+void Prefetcher::schedule(std::vector<std::string> const &files) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!_limit) return;
+    _queue.insert(_queue.end(), files.begin(), files.end());
+    if (!_thread.joinable()) _thread = std::thread(&Prefetcher::_run, this);
+    _wake.notify_all();
+}
+
+bool Prefetcher::take(std::string const &file, std::string &text) {
+    std::unique_lock<std::mutex> guard(_lock);
+    // A queued file that has not been started is cheaper to read directly than to wait for
+    auto const queued = std::find(_queue.begin(), _queue.end(), file);
+    if (queued != _queue.end()) {
+        _queue.erase(queued);
+        return false;
+    }
+    _wake.wait(guard, [this, &file]() { return _reading != file; });
+    auto const ready = _ready.find(file);
+    if (ready == _ready.end()) return false;
+    text = std::move(ready->second);
+    _held -= text.size();
+    _ready.erase(ready);
+    _wake.notify_all();
+    return true;
+}
+
+void Prefetcher::discard(std::string const &file) {
+    std::string text;
+    if (take(file, text)) text = std::string();
+}
+
+void Prefetcher::limit(size_t const bytes) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _limit = bytes;
+    if (!_limit) _queue.clear();
+    _wake.notify_all();
+}
+
+static size_t fileSize(std::string const &file) {
+    struct stat info;
+    return stat(file.c_str(), &info) ? 0 : (size_t)info.st_size;
+}
+
+void Prefetcher::_run() {
+    std::unique_lock<std::mutex> guard(_lock);
+    size_t size = 0;
+    // The next file waits for taken reads to free room, unless it could never fit anyway
+    auto const ready = [this, &size]() {
+        if (_stop) return true;
+        if (_queue.empty()) return false;
+        size = fileSize(_queue.front());
+        return size > _limit || _held + size <= _limit;
+    };
+    while (true) {
+        _wake.wait(guard, ready);
+        if (_stop) return;
+        _reading = _queue.front();
+        _queue.pop_front();
+        auto const file = _reading;
+        auto const fits = size <= _limit;
+        guard.unlock();
+
+        std::string text;
+        if (fits) {
+            text = Utils::readFile(file.c_str());
+        } else {
+            #ifdef POSIX_FADV_WILLNEED
+            auto const fd = open(file.c_str(), O_RDONLY);
+            if (fd >= 0) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                close(fd);
+            }
+            #endif
+        }
+
+        guard.lock();
+        if (fits) {
+            _held += text.size();
+            _ready[file] = std::move(text);
+        }
+        _reading.clear();
+        _wake.notify_all();
+    }
+}
@@ -0,0 +1,214 @@
+#include "SpillManager.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char const FILE_MAGIC[8] = "AFCOL01";
+static_assert(sizeof(SpillManager::FileHeader) <= SpillManager::headerSize, "Column file header too large");
+
+SpillManager::Block::~Block() {
+    SpillManager::instance()._release(this);
+}
+
+SpillManager &SpillManager::instance() {
+    static SpillManager manager;
+    return manager;
+}
+
+std::shared_ptr<SpillManager::Block> SpillManager::spill(af::array const &array) {
+    auto block = std::make_shared<Block>(array.dims(), array.type(), array.bytes());
+    block->_memory = malloc(block->_bytes);
+    if (!block->_memory) throw std::bad_alloc();
+    array.host(block->_memory);
+
+    std::vector<Block*> victims;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _resident.push_front(block.get());
+        block->_lru = _resident.begin();
+        _residentBytes += block->_bytes;
+        victims = _victims();
+    }
+    _evict(victims);
+    return block;
+}
+
+af::array SpillManager::load(Block &block) {
+    af::array out(block._dims, block._type);
+    std::unique_lock<std::mutex> guard(_lock);
+    // A block being written has left the resident list but its buffer is still whole
+    auto const memory = block._memory;
+    auto const path = block._path;
+    if (path.empty()) _resident.splice(_resident.begin(), _resident, block._lru);
+    ++block._readers;
+    guard.unlock();
+    try {
+        if (memory) {
+            out.write((unsigned char const *)memory, block._bytes);
+        } else {
+            FileHeader header;
+            size_t length;
+            auto map = mapFile(path, header, length);
+            out.write((unsigned char const *)map + headerSize, block._bytes);
+            unmapFile(map, length);
+        }
+    } catch (...) {
+        _doneReading(block);
+        throw;
+    }
+    _doneReading(block);
+    return out;
+}
+
+void SpillManager::directory(std::string const &dir) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _directory = dir;
+    if (!_directory.empty() && _directory.back() != '/') _directory += '/';
+}
+
+void SpillManager::budget(size_t const bytes) {
+    std::vector<Block*> victims;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _budget = bytes;
+        victims = _victims();
+    }
+    _evict(victims);
+}
+
+std::vector<SpillManager::Block*> SpillManager::_victims() {
+    std::vector<Block*> victims;
+    while (_residentBytes > _budget && !_resident.empty()) {
+        auto block = _resident.back();
+        char name[64];
+        snprintf(name, sizeof(name), "spill_%d_%llu.afcol", (int)getpid(), _counter++);
+        block->_path = _directory + name;
+        block->_writing = true;
+        _resident.pop_back();
+        _residentBytes -= block->_bytes;
+        _spilledBytes += block->_bytes;
+        victims.push_back(block);
+    }
+    return victims;
+}
+
+void SpillManager::_evict(std::vector<Block*> const &victims) {
+    for (size_t i = 0; i < victims.size(); ++i) {
+        auto block = victims[i];
+        try {
+            writeFile(block->_path, block->_memory, block->_dims, block->_type, block->_bytes);
+        } catch (...) {
+            // Blocks not yet written go back to the resident list
+            std::lock_guard<std::mutex> guard(_lock);
+            for (auto j = i; j < victims.size(); ++j) {
+                auto failed = victims[j];
+                if (j == i) unlink(failed->_path.c_str());
+                failed->_path.clear();
+                failed->_writing = false;
+                _resident.push_back(failed);
+                failed->_lru = std::prev(_resident.end());
+                _residentBytes += failed->_bytes;
+                _spilledBytes -= failed->_bytes;
+            }
+            _idle.notify_all();
+            throw;
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        block->_writing = false;
+        if (!block->_readers) {
+            free(block->_memory);
+            block->_memory = nullptr;
+        }
+        _idle.notify_all();
+    }
+}
+
+void SpillManager::_doneReading(Block &block) {
+    std::lock_guard<std::mutex> guard(_lock);
+    // The last reader of a written block frees the buffer the eviction left behind
+    if (!--block._readers && !block._writing && !block._path.empty() && block._memory) {
+        free(block._memory);
+        block._memory = nullptr;
+    }
+    _idle.notify_all();
+}
+
+void SpillManager::_release(Block *block) {
+    std::unique_lock<std::mutex> guard(_lock);
+    _idle.wait(guard, [block]() { return !block->_writing && !block->_readers; });
+    if (block->_memory && block->_path.empty()) {
+        _resident.erase(block->_lru);
+        _residentBytes -= block->_bytes;
+        free(block->_memory);
+        block->_memory = nullptr;
+    } else if (!block->_path.empty()) {
+        unlink(block->_path.c_str());
+        _spilledBytes -= block->_bytes;
+    }
+}
+
+void SpillManager::writeFile(std::string const &path, void const *data, af::dim4 const &dims, af::dtype const type,
+                             size_t const bytes, void const *trailer, size_t const trailerBytes) {
+    char msg[256];
+    char header[headerSize] = {0};
+    FileHeader info;
+    memcpy(info.magic, FILE_MAGIC, sizeof(info.magic));
+    info.version = 1;
+    info.type = type;
+    for (unsigned int i = 0; i < 4; ++i) info.dims[i] = dims[i];
+    info.bytes = bytes;
+    memcpy(header, &info, sizeof(info));
+
+    auto file = fopen(path.c_str(), "wb");
+    if (!file) {
+        snprintf(msg, sizeof(msg), "Could not open %s for writing", path.c_str());
+        throw std::runtime_error(msg);
+    }
+    auto const written = fwrite(header, 1, headerSize, file) == headerSize && fwrite(data, 1, bytes, file) == bytes &&
+                         (!trailerBytes || fwrite(trailer, 1, trailerBytes, file) == trailerBytes);
+    if (fclose(file) || !written) {
+        snprintf(msg, sizeof(msg), "Failed to write %s", path.c_str());
+        throw std::runtime_error(msg);
+    }
+}
+
+void *SpillManager::mapFile(std::string const &path, FileHeader &header, size_t &length) {
+    char msg[256];
+    auto const fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        snprintf(msg, sizeof(msg), "Could not open %s", path.c_str());
+        throw std::runtime_error(msg);
+    }
+    struct stat info;
+    if (fstat(fd, &info) || (size_t)info.st_size < headerSize) {
+        close(fd);
+        snprintf(msg, sizeof(msg), "%s is not a column file", path.c_str());
+        throw std::runtime_error(msg);
+    }
+    length = (size_t)info.st_size;
+    auto map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(msg, sizeof(msg), "Could not map %s", path.c_str());
+        throw std::runtime_error(msg);
+    }
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) || header.bytes + headerSize > length) {
+        munmap(map, length);
+        snprintf(msg, sizeof(msg), "%s is not a column file", path.c_str());
+        throw std::runtime_error(msg);
+    }
+    madvise(map, length, MADV_SEQUENTIAL);
+    return map;
+}
+
+void SpillManager::unmapFile(void *map, size_t const length) {
+    munmap(map, length);
+}
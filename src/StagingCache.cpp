@@ -0,0 +1,77 @@
+#include "StagingCache.h"
+#include "Prefetcher.h"
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <exception>
+
+namespace fs = boost::filesystem;
+// Bump when the column file layout, any column encoding or how a parsed field is decoded changes. Field positions
+// and types are part of every key already
+static char const CACHE_VERSION[] = "AFCOL01.2";
+
+static unsigned long long fnv1a(unsigned long long hash, std::string const &bytes) {
+    for (auto const c : bytes) {
+        hash ^= (unsigned char)c;
+        hash *= 0x100000001b3llU;
+    }
+    return hash ^ 0xff;
+}
+
+StagingCache::Key::Key(std::string table, std::vector<std::string> const &inputs, std::string const &schema) :
+        _table(std::move(table)), _inputs(inputs) {
+    if (directory().empty()) return;
+    auto paths = 0xcbf29ce484222325llU;
+    auto hash = fnv1a(fnv1a(0xcbf29ce484222325llU, CACHE_VERSION), schema);
+    for (auto const &input : inputs) {
+        boost::system::error_code error;
+        auto const size = fs::file_size(input, error);
+        if (error) return;
+        auto const modified = fs::last_write_time(input, error);
+        if (error) return;
+        paths = fnv1a(paths, input);
+        hash = fnv1a(hash, input);
+        hash = fnv1a(hash, std::to_string(size));
+        hash = fnv1a(hash, std::to_string((long long)modified));
+    }
+    char id[48];
+    snprintf(id, sizeof(id), "-%016llx-", paths);
+    _prefix = _table + id;
+    snprintf(id, sizeof(id), "%016llx", hash);
+    _id = _prefix + id;
+}
+
+bool StagingCache::fetch(Key const &key, AFDataFrame &frame, std::string const &part) {
+    if (!key.valid() || !fs::is_directory(fs::path(directory()) / (key.id() + part))) return false;
+    try {
+        frame = AFDataFrame::readColumnar(directory(), key.id() + part);
+    } catch (std::runtime_error const &) {
+        // A damaged entry is parsed again and overwritten
+        return false;
+    }
+    frame.name(key.table());
+    // Inputs read ahead for the parse that is now skipped would otherwise stay pinned in the prefetcher
+    for (auto const &input : key.inputs()) Prefetcher::instance().discard(input);
+    return true;
+}
+
+void StagingCache::store(Key const &key, AFDataFrame const &frame, std::string const &part) {
+    if (!key.valid()) return;
+    auto const root = fs::path(directory());
+    auto const name = key.id() + part;
+    auto const staging = name + ".tmp";
+
+    // Entries parsed from the same files under an older key can never be hit again. Loaders that run once per
+    // batch share a table name, their entries differ in the input paths and are kept
+    fs::create_directories(root);
+    for (fs::directory_iterator i(root), end; i != end; ++i) {
+        auto const entry = i->path().filename().string();
+        if (!entry.compare(0, key.prefix().size(), key.prefix()) && entry.compare(0, key.id().size(), key.id())) {
+            fs::remove_all(i->path());
+        }
+    }
+
+    // Written under a temporary name first so an interrupted run never leaves a partial entry behind
+    frame.writeColumnar(root.string(), staging);
+    fs::remove_all(root / name);
+    fs::rename(root / staging, root / name);
+}
@@ -0,0 +1,77 @@
+#include "SyntheticData.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef unsigned long long ull;
+using namespace af;
+
+void Synthetic::seed(ull const value) {
+    setSeed(value);
+}
+
+Column Synthetic::keys(dim_t const rows, ull const distinct, double const skew) {
+    if (!rows || !distinct) return Column(array(dim4(1, 0), u64), ULONG);
+    auto u = randu(dim4(1, rows), f64);
+    if (skew > 0) u = pow(u, 1 + skew);
+    auto const key = min(floor(u * (double)distinct), (double)(distinct - 1)).as(u64);
+    return Column(key, ULONG);
+}
+
+Column Synthetic::strings(dim_t const rows, unsigned int const length) {
+    if (!rows) return Column(array(0, u8), array(dim4(2, 0), u64));
+    auto const lo = std::max(length / 2, 1u);
+    auto const hi = std::max(length + length / 2, lo);
+    // Lengths include the terminator
+    auto len = min(floor(randu(dim4(1, rows), f32) * (hi - lo + 1)) + lo, (double)hi).as(u64) + 1;
+    auto const start = rows > 1 ? scan(len, 1, AF_BINARY_ADD, false) : constant(0, 1, u64);
+    auto data = (floor(randu(sum<ull>(len), f32) * 26) + 'a').as(u8);
+    data(start + len - 1) = 0;
+    return Column(data, join(0, start, len));
+}
+
+Column Synthetic::keyedStrings(Column const &keys, unsigned int const length) {
+    if (!keys.length()) return strings(0, length);
+    auto const dictionary = strings((dim_t)max<ull>(keys.data()) + 1, length);
+    return dictionary.select(keys.data());
+}
+
+Column Synthetic::numericText(dim_t const rows, dtype const type, double const empty) {
+    std::vector<double> values(rows);
+    std::vector<float> blanks(rows);
+    if (rows) {
+        randu(rows, f64).host(values.data());
+        randu(rows, f32).host(blanks.data());
+    }
+    double lo;
+    double hi;
+    switch (type) {
+        case u8: lo = 0; hi = 255; break;
+        case s16: lo = -32767; hi = 32767; break;
+        case u16: lo = 0; hi = 65535; break;
+        case s32: lo = -2147483647.0; hi = 2147483647.0; break;
+        case u32: lo = 0; hi = 4294967295.0; break;
+        case s64: lo = -9e15; hi = 9e15; break;
+        case u64: lo = 0; hi = 1.8e16; break;
+        case f32: case f64: lo = -1e6; hi = 1e6; break;
+        default: throw std::runtime_error("Expected a numeric type");
+    }
+
+    std::string text;
+    text.reserve(rows * 12);
+    char field[32];
+    for (dim_t i = 0; i < rows; ++i) {
+        if (blanks[i] >= empty) {
+            auto const value = lo + values[i] * (hi - lo);
+            if (type == f32 || type == f64) snprintf(field, sizeof(field), "%.6f", value);
+            else if (lo < 0) snprintf(field, sizeof(field), "%lld", (long long)value);
+            else snprintf(field, sizeof(field), "%llu", (ull)value);
+            text += field;
+        }
+        text.push_back('\0');
+    }
+    if (text.empty()) return Column(array(0, u8), array(dim4(2, 0), u64));
+    return Column(array(text.size(), text.data()).as(u8), STRING);
+}
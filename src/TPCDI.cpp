@@ -6,6 +6,8 @@
 #include "BatchFunctions.h"
 #include "Logger.h"
 #include "ColumnNames.h"
+#include "StagingCache.h"
+#include "KernelInterface.h"
 #ifdef ITT_ENABLED
     #include <ittnotify.h>
 #endif
@@ -31,6 +33,17 @@ std::vector<std::string> inline collectFinwireFiles(char const *directory) {
     return finwireFiles;
 }
 
+/* Parses the fields of a schema into the frame, one column each. Cache keys are built from the same schema, so a
+ * change to the parse always misses entries written before it */
+static void parseSchema(AFParser const &parser, Schema const &schema, AFDataFrame &frame) {
+    for (auto const &field : schema) frame.add(parser.parse(field));
+}
+
+/* Fields first to last, all parsed as one type */
+static void addFields(Schema &schema, int const first, int const last, DataType const type) {
+    for (int i = first; i <= last; ++i) schema.push_back({i, type});
+}
+
 AFDataFrame loadBatchDate(char const* directory) {
     char file[128];
     strcpy(file, directory);
@@ -50,18 +63,17 @@ AFDataFrame loadDimDate(char const *directory) {
     strcpy(file, directory);
     strcat(file, "Date.txt");
     AFDataFrame frame;
-    Logger::startTimer("DimDate");
+    Schema schema = {{0, ULONG}, {1, DATE}};
+    for (int i = 2;  i < 17; i += 2) schema.insert(schema.end(), {{i, STRING}, {i + 1, UINT}});
+    schema.push_back({17, BOOL});
+    StagingCache::Key const key("DimDate", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("DimDate");
     AFParser parser(file, '|', false);
-
-    frame.add(parser.parse<unsigned long long>(0));
-    frame.add(parser.asDate(1, true, YYYYMMDD));
-    for (int i = 2;  i < 17; i += 2) {
-        frame.add(parser.parse<char*>(i));
-        frame.add(parser.parse<unsigned int>(i + 1));
-    }
-    frame.add(parser.parse<bool>(17));
-    Logger::logTime("DimDate", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -70,19 +82,17 @@ AFDataFrame loadDimTime(char const* directory) {
     strcpy(file, directory);
     strcat(file, "Time.txt");
     AFDataFrame frame;
-    Logger::startTimer("DimTime");
+    Schema schema = {{0, ULONG}, {1, TIME}};
+    for (int i = 2;  i < 7; i += 2) schema.insert(schema.end(), {{i, UINT}, {i + 1, STRING}});
+    addFields(schema, 8, 9, BOOL);
+    StagingCache::Key const key("DimTime", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("DimTime");
     AFParser parser(file, '|', false);
-    frame.add(parser.parse<unsigned long long>(0));
-    frame.add(parser.asTime(1, true));
-
-    for (int i = 2;  i < 7; i += 2) {
-        frame.add(parser.parse<unsigned int>(i));
-        frame.add(parser.parse<char*>(i + 1));
-    }
-    frame.add(parser.parse<bool>(8));
-    frame.add(parser.parse<bool>(9));
-    Logger::logTime("DimTime", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -91,17 +101,22 @@ AFDataFrame loadIndustry(char const* directory) {
     strcpy(file, directory);
     strcat(file, "Industry.txt");
 
-    Logger::startTimer("Industry");
     AFDataFrame frame;
+    Schema schema;
+    addFields(schema, 0, 2, STRING);
+    StagingCache::Key const key("Industry", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("Industry");
     AFParser parser(file, '|', false);
-    for (int i = 0;  i < 3; ++i) frame.add(parser.parse<char*>(i));
-    Logger::logTime("Industry", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
 
     frame.name("Industry");
     frame.nameColumn("IN_ID", 0);
     frame.nameColumn("IN_NAME", 1);
     frame.nameColumn("IN_SC_ID", 2);
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -110,14 +125,19 @@ AFDataFrame loadStatusType(char const* directory) {
     strcpy(file, directory);
     strcat(file, "StatusType.txt");
 
-    Logger::startTimer("StatusType");
     AFDataFrame frame;
+    Schema const schema = {{0, STRING}, {1, STRING}};
+    StagingCache::Key const key("StatusType", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("StatusType");
     AFParser parser(file, '|', false);
-    frame.add(parser.parse<char*>(0), "ST_ID");
-    frame.add(parser.parse<char*>(1), "ST_NAME");
-    Logger::logTime("StatusType", false);
+    parseSchema(parser, schema, frame);
+    frame.nameColumn("ST_ID", 0);
+    frame.nameColumn("ST_NAME", 1);
+    timer.stop();
     frame.name("StatusType");
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -126,16 +146,21 @@ AFDataFrame loadTaxRate(char const* directory) {
     strcpy(file, directory);
     strcat(file, "TaxRate.txt");
 
-    Logger::startTimer("TaxRate");
     AFDataFrame frame;
+    Schema const schema = {{0, STRING}, {1, STRING}, {2, FLOAT}};
+    StagingCache::Key const key("TaxRate", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("TaxRate");
     AFParser parser(file, '|', false);
 
     frame.name("TaxRate");
-    frame.add(parser.parse<char*>(0), "TX_ID");
-    frame.add(parser.parse<char*>(1), "TX_NAME");
-    frame.add(parser.parse<float>(2), "TX_RATE");
-    Logger::logTime("TaxRate", false);
+    parseSchema(parser, schema, frame);
+    frame.nameColumn("TX_ID", 0);
+    frame.nameColumn("TX_NAME", 1);
+    frame.nameColumn("TX_RATE", 2);
+    timer.stop();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -144,15 +169,19 @@ AFDataFrame loadTradeType(char const* directory) {
     strcpy(file, directory);
     strcat(file, "TradeType.txt");
 
-    Logger::startTimer("TradeType");
     AFDataFrame frame;
+    Schema schema;
+    addFields(schema, 0, 1, STRING);
+    addFields(schema, 2, 3, UINT);
+    StagingCache::Key const key("TradeType", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("TradeType");
     AFParser parser(file, '|', false);
+    parseSchema(parser, schema, frame);
 
-    for (int i = 0;  i < 2; ++i) frame.add(parser.parse<char*>(i));
-    for (int i = 2;  i < 4; ++i) frame.add(parser.parse<unsigned int>(i));
-
-    Logger::logTime("TradeType", false);
+    timer.stop();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -161,23 +190,23 @@ AFDataFrame loadStagingMarket(char const* directory) {
     strcpy(file, directory);
     strcat(file, "DailyMarket.txt");
     AFDataFrame frame;
+    Schema const schema = {{0, DATE}, {1, STRING}, {2, FLOAT}, {3, FLOAT}, {4, FLOAT}, {5, ULONG}};
+    StagingCache::Key const key("DailyMarket", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
     // Logger::startCollection();
-    Logger::startTimer("DailyMarket");
+    Logger::ScopedTimer timer("DailyMarket");
     AFParser parser(file, '|', false);
 
-    af::deviceGC();
-    frame.add(parser.parse<char*>(0), "DM_DATE");
-    frame(0).toDate(true);
-    af::deviceGC();
-    frame.add(parser.parse<char*>(1), "DM_S_SYMB");
-    frame.add(parser.parse<float>(2), "DM_CLOSE");
-    frame.add(parser.parse<float>(3), "DM_HIGH");
-    af::deviceGC();
-    frame.add(parser.parse<float>(4), "DM_LOW");
-    frame.add(parser.parse<unsigned long long>(5), "DM_VOL");
-    Logger::logTime("DailyMarket", false);
+    callGC();
+    parseSchema(parser, schema, frame);
+    int i = 0;
+    for (auto const name : {"DM_DATE", "DM_S_SYMB", "DM_CLOSE", "DM_HIGH", "DM_LOW", "DM_VOL"}) {
+        frame.nameColumn(name, i++);
+    }
+    timer.stop();
     // Logger::pauseCollection();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -193,35 +222,34 @@ AFDataFrame loadAudit(char const* directory) {
         auditFiles.push_back( i->path().string() );
     }
     std::sort(auditFiles.begin(), auditFiles.end());
+    Schema const schema = {{0, STRING}, {1, UINT}, {2, DATE}, {3, STRING}, {4, INT}, {5, DOUBLE}};
+    StagingCache::Key const key("Audit", auditFiles, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
 
     // Logger::startCollection();
     // Logger::startTask("Audit Load");
-    Logger::startTimer("Audit");
+    Logger::ScopedTimer timer("Audit");
     AFParser parser(auditFiles, ',', true);
     // Logger::endLastTask();
 
     // Logger::startTask("Audit Parse");
-    frame.add(parser.parse<char*>(0));
-    frame.add(parser.parse<unsigned int>(1));
-    frame.add(parser.asDate(2, true, YYYYMMDD));
-    frame.add(parser.parse<char*>(3));
-    frame.add(parser.parse<int>(4));
-    frame.add(parser.parse<double>(5));
-    Logger::logTime("Audit", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
     // Logger::endLastTask();
 
     // Logger::pauseCollection();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
 AFDataFrame loadStagingSecurity(char const *directory) {
     std::vector<std::string> finwireFiles = collectFinwireFiles(directory);
     // Logger::startCollection();
-    Logger::startTimer("StagingSecurity");
+    Logger::ScopedTimer timer("StagingSecurity");
     FinwireParser parser(finwireFiles);
     auto sec = parser.extractSec();
-    Logger::logTime("StagingSecurity", false);
+    timer.stop();
     // Logger::pauseCollection();
     nameStagingSecurity(sec);
     return sec;
@@ -230,10 +258,10 @@ AFDataFrame loadStagingSecurity(char const *directory) {
 AFDataFrame loadStagingCompany(char const *directory) {
     std::vector<std::string> finwireFiles = collectFinwireFiles(directory);
     // Logger::startCollection();
-    Logger::startTimer("StagingCompany");
+    Logger::ScopedTimer timer("StagingCompany");
     FinwireParser parser(finwireFiles);
     auto cmp = parser.extractCmp();
-    Logger::logTime("StagingCompany", false);
+    timer.stop();
     // Logger::pauseCollection();
     nameStagingCompany(cmp);
     return cmp;
@@ -242,10 +270,10 @@ AFDataFrame loadStagingCompany(char const *directory) {
 AFDataFrame loadStagingFinancial(char const *directory) {
     std::vector<std::string> finwireFiles = collectFinwireFiles(directory);
     // Logger::startCollection();
-    Logger::startTimer("StagingFinancial");
+    Logger::ScopedTimer timer("StagingFinancial");
     FinwireParser parser(finwireFiles);
     auto fin = parser.extractFin();
-    Logger::logTime("StagingFinancial", false);
+    timer.stop();
     // Logger::pauseCollection();
     nameStagingFinancial(fin);
     return fin;
@@ -255,7 +283,15 @@ Finwire loadStagingFinwire(char const *directory) {
     std::vector<std::string> finwireFiles = collectFinwireFiles(directory);
     //    // Logger::startCollection();
     Logger::startTimer("Finwire Ingestion");
-    Finwire finwire = FinwireParser(finwireFiles).extractData();
+    StagingCache::Key const key("Finwire", finwireFiles, FinwireParser::describe());
+    Finwire finwire{AFDataFrame(), AFDataFrame(), AFDataFrame()};
+    if (!StagingCache::fetch(key, finwire.company, ".cmp") || !StagingCache::fetch(key, finwire.financial, ".fin") ||
+        !StagingCache::fetch(key, finwire.security, ".sec")) {
+        finwire = FinwireParser::parseFiles(finwireFiles);
+        StagingCache::store(key, finwire.company, ".cmp");
+        StagingCache::store(key, finwire.financial, ".fin");
+        StagingCache::store(key, finwire.security, ".sec");
+    }
     Logger::logTime("Finwire Ingestion", false);
 
     Logger::startTimer("StagingCompany");
@@ -278,8 +314,16 @@ AFDataFrame loadStagingProspect(char const *directory) {
     char file[128];
     strcpy(file, directory);
     strcat(file, "Prospect.csv");
-    Logger::startTimer("StagingProspect");
     AFDataFrame frame;
+    Schema schema;
+    addFields(schema, 0, 11, STRING);
+    schema.push_back({12, ULONG});
+    addFields(schema, 13, 14, UCHAR);
+    schema.insert(schema.end(), {{15, STRING}, {16, USHORT}, {17, UINT}, {18, STRING}, {19, STRING}, {20, UCHAR},
+                                 {21, ULONG}});
+    StagingCache::Key const key("StagingProspect", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("StagingProspect");
     // Logger::startCollection();
 
     // Logger::startTask("Staging Prospect Load");
@@ -287,30 +331,24 @@ AFDataFrame loadStagingProspect(char const *directory) {
     // Logger::endLastTask();
 
     // Logger::startTask("Staging Prospect Parse");
-    for (int i = 0;  i < 12; ++i) frame.add(parser.parse<char*>(i));
-
-    frame.add(parser.parse<unsigned long long>(12));
-
-    for (int i = 13;  i < 15; ++i) frame.add(parser.parse<unsigned char>(i));
-
-    frame.add(parser.parse<char*>(15));
-    frame.add(parser.parse<unsigned short>(16));
-    frame.add(parser.parse<unsigned int>(17));
-
-    for (int i = 18;  i < 20; ++i) frame.add(parser.parse<char*>(i));
-
-    frame.add(parser.parse<unsigned char>(20));
-    frame.add(parser.parse<unsigned long long>(21));
+    parseSchema(parser, schema, frame);
     // Logger::endLastTask();
-    Logger::logTime("StagingProspect", false);
+    timer.stop();
     // Logger::pauseCollection();
     nameStagingProspect(frame);
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
 AFDataFrame loadStagingCustomer(char const* directory) {
     AFDataFrame frame;
+    Schema schema = {{0, STRING}, {1, DATETIME}, {2, ULONG}, {3, STRING}, {4, STRING}, {5, UCHAR}, {6, DATE}};
+    addFields(schema, 7, 31, STRING);
+    schema.insert(schema.end(), {{32, ULONG}, {33, USHORT}, {34, ULONG}, {35, STRING}});
+    StagingCache::Key const key("StagingCustomer", {std::string(directory) + "CustomerMgmt.xml"},
+                                AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
     // Logger::startCollection();
 
     // Logger::startTask("Flattening XML");
@@ -319,31 +357,18 @@ AFDataFrame loadStagingCustomer(char const* directory) {
     // Logger::endLastTask();
 
     // Logger::startTask("Customer Load");
-    Logger::startTimer("StagingCustomer");
+    Logger::ScopedTimer timer("StagingCustomer");
     AFParser parser(data, '|', false);
     // Logger::endLastTask();
 
     // Logger::startTask("Customer Parse");
-    frame.add(parser.parse<char*>(0));
-    frame.add(parser.asDateTime(1, YYYYMMDD));
-    frame.add(parser.parse<unsigned long long>(2));
-
-    for (int i = 3; i < 5; ++i) frame.add(parser.parse<char*>(i));
-
-    frame.add(parser.parse<unsigned char>(5));
-    frame.add(parser.asDate(6, true, YYYYMMDD));
-    callGC();
-    for (int i = 7; i < 32; ++i) frame.add(parser.parse<char*>(i));
-    callGC();
-    frame.add(parser.parse<unsigned long long>(32));
-    frame.add(parser.parse<unsigned short>(33));
-    frame.add(parser.parse<unsigned long long>(34));
-    frame.add(parser.parse<char*>(35));
-    Logger::logTime("StagingProspect", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
     // Logger::endLastTask();
 
     callGC();
     nameStagingProspect(frame);
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -376,8 +401,11 @@ AFDataFrame loadDimBroker(char const* directory, AFDataFrame& dimDate) {
     dimBroker.insert(Column(range(dim4(1, length), 1, u64)), 0);
     dimBroker.add(Column(constant(1, dim4(1, length), b8)));
     dimBroker.add(Column(constant(1, dim4(1, length), u32)));
-    dimDate.sortBy(0);
-    auto date = dimDate(1)(af::span, 0);
+    // DimDate is shared with concurrent readers, find its earliest row rather than sorting it in place
+    array earliest;
+    array first;
+    min(earliest, first, dimDate(0).data(), 1);
+    array const date = dimDate(1)(af::span, first);
     dimBroker.add(Column(tile(date, dim4(1, length)), DATE));
     dimBroker.add(Utils::endDate(length));
     Logger::logTime("DimBroker", false);
@@ -386,26 +414,29 @@ AFDataFrame loadDimBroker(char const* directory, AFDataFrame& dimDate) {
     return dimBroker;
 }
 
-AFDataFrame loadStagingCashBalances(char const* directory) {
+AFDataFrame loadStagingCashBalances(char const* directory, bool const isIncremental) {
     char file[128];
     strcpy(file, directory);
     strcat(file, "CashTransaction.txt");
     AFDataFrame frame;
+    // Incremental batches prefix every record with CDC_FLAG and CDC_DSN
+    auto const c = isIncremental ? 2 : 0;
+    Schema const schema = {{c, ULONG}, {c + 1, DATETIME}, {c + 2, DOUBLE}, {c + 3, STRING}};
+    StagingCache::Key const key("StagingCashBalances", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
     // Logger::startCollection();
 
     // Logger::startTask("Cash Load");
-    Logger::startTimer("StagingCashBalances");
+    Logger::ScopedTimer timer("StagingCashBalances");
     AFParser parser(file, '|', false);
     // Logger::endLastTask();
     
-    frame.add(parser.parse<unsigned long long>(0));
-    frame.add(parser.asDateTime(1, YYYYMMDD));
-    frame.add(parser.parse<double>(2));
-    frame.add(parser.parse<char*>(3));
-    Logger::logTime("StagingCashBalances", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
 
     // Logger::pauseCollection();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -413,19 +444,19 @@ AFDataFrame loadStagingWatches(char const* directory) {
     char file[128];
     strcpy(file, directory);
     strcat(file, "WatchHistory.txt");
-    // Logger::startCollection();
-    Logger::startTimer("StagingWatches");
     AFDataFrame frame;
+    Schema const schema = {{0, ULONG}, {1, STRING}, {2, DATETIME}, {3, STRING}};
+    StagingCache::Key const key("StagingWatches", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    // Logger::startCollection();
+    Logger::ScopedTimer timer("StagingWatches");
     AFParser parser(file, '|', false);
-
-    frame.add(parser.parse<unsigned long long>(0));
-    frame.add(parser.parse<char*>(1));
-    frame.add(parser.asDateTime(2, YYYYMMDD));
-    frame.add(parser.parse<char*>(3));
-    Logger::logTime("StagingWatches", false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
 
     // Logger::pauseCollection();
     callGC();
+    StagingCache::store(key, frame);
     return frame;
 }
 
@@ -459,31 +490,7 @@ AFDataFrame loadDimCompany(AFDataFrame &&s_Company, AFDataFrame &industry, AFDat
     Logger::logTime("DimCompany", false);
 
     Logger::startTimer("DimCompany SCD");
-    // Logger::startTask("DimCompany Update EndDate");
-    auto s0 = dimCompany.project({ "SK_CompanyID", "CompanyID", "EffectiveDate"}, "S0");
-    s0.sortBy({ "CompanyID", "EffectiveDate" });
-
-    auto s2 = s0.project({ "CompanyID" }, "S2");
-    auto s1 = s0.select(range(dim4(s0.rows() - 1), 0, u64) + 1);
-    s2 = s2.select(range(dim4(s2.rows() - 1), 0, u64), "S2");
-    s1 = s1.zip(s2);
-    s1 = s1.select(s1("CompanyID") == s1("S2.CompanyID"), "S1");
-    auto end_date = s1.project({ "EffectiveDate" }, "EndDate");
-
-    s0 = s0.project({ "SK_CompanyID", "CompanyID" }, "S0");
-    s1 = s0.project({ "CompanyID" }, "S1");
-    s0 = s0.select(range(dim4(s0.rows() - 1), 0, u64), "S0");
-    s1 = s1.select(range(dim4(s1.rows() - 1), 0, u64) + 1, "S1");
-    s0 = s0.zip(s1);
-    s0 = s0.select(s0("CompanyID") == s0("S1.CompanyID"), "S0");
-    s0 = s0.project({ "SK_CompanyID" }, "S0");
-
-    s0 = s0.zip(end_date);
-    s0.nameColumn("EndDate", "EndDate.EffectiveDate");
-    // Logger::startTask("DimCompany EndDate ID");
-    auto out = AFDataFrame::hashCompare(dimCompany("SK_CompanyID").data(), s0("SK_CompanyID").data());
-    dimCompany("IsCurrent")(out.first) = 0;
-    dimCompany("EndDate")(span, out.first) = (array) s0("EndDate")(span, out.second);
+    dimCompany.applySCD2("CompanyID", "EffectiveDate", "SK_CompanyID");
     Logger::logTime("DimCompany SCD", false);
     // Logger::endLastTask();
     // Logger::endLastTask();
@@ -496,7 +503,8 @@ AFDataFrame loadDimCompany(AFDataFrame &&s_Company, AFDataFrame &industry, AFDat
 AFDataFrame loadFinancial(AFDataFrame &&s_Financial, AFDataFrame const &dimCompany) {
     AFDataFrame financial;
     // Logger::startCollection();
-    Logger::startTimer("Financial");
+    Logger::ScopedTimer timer("Financial");
+    s_Financial("PTS").toDate();
     // Logger::startTask("Financial CIK Trim");
     auto cik = s_Financial("CO_NAME_OR_CIK").left(1) == "0";
     // Logger::endLastTask();
@@ -505,40 +513,36 @@ AFDataFrame loadFinancial(AFDataFrame &&s_Financial, AFDataFrame const &dimCompa
     fin1("CO_NAME_OR_CIK").cast<unsigned long long>();
     // Logger::endLastTask();
     // Logger::startTask("Financial CIK Join");
-    financial = fin1.equiJoin(
-            dimCompany.project({"SK_CompanyID", "CompanyID", "EffectiveDate", "EndDate"}, "DC"),
-            "CO_NAME_OR_CIK", "CompanyID");
+    // Each filing joins the one company version in effect on its posting date
+    financial = fin1.asOfJoin(dimCompany.project({"SK_CompanyID", "CompanyID", "EffectiveDate", "EndDate"}, "DC"),
+                              "CO_NAME_OR_CIK", "PTS", "CompanyID", "EffectiveDate", "EndDate");
     // Logger::endLastTask();
-    financial.remove("CO_NAME_OR_CIK");
-    financial.remove("DC.CompanyID");
+    if (!financial.isEmpty()) {
+        financial.remove("CO_NAME_OR_CIK");
+        financial.remove("DC.CompanyID");
+    }
 
     // Logger::startTask("Financial Name Select");
     fin1 = s_Financial.select(!cik);
     // Logger::endLastTask();
 
     // Logger::startTask("Financial Name Join");
-    fin1 = fin1.equiJoin(
-            dimCompany.project({"SK_CompanyID", "Name", "EffectiveDate", "EndDate"}, "DC"), "CO_NAME_OR_CIK", "Name");
+    fin1 = fin1.asOfJoin(dimCompany.project({"SK_CompanyID", "Name", "EffectiveDate", "EndDate"}, "DC"),
+                         "CO_NAME_OR_CIK", "PTS", "Name", "EffectiveDate", "EndDate");
     // Logger::endLastTask();
-    fin1.remove("CO_NAME_OR_CIK");
-    fin1.remove("DC.Name");
-
-    if (!fin1.isEmpty()) financial = financial.unionize(std::move(fin1));
+    if (!fin1.isEmpty()) {
+        fin1.remove("CO_NAME_OR_CIK");
+        fin1.remove("DC.Name");
+        financial = financial.isEmpty() ? fin1 : financial.unionize(std::move(fin1));
+    }
     af::sync();
 
-    financial("PTS").toDate();
-    
-    financial = financial.select(
-            financial("DC.EffectiveDate") <= financial("PTS") &&
-            financial("DC.EndDate") > financial("PTS")
-            );
-
     financial = financial.project({ "DC.SK_CompanyID", "YEAR", "QUARTER", "QTR_START_DATE","REVENUE", "EARNINGS",
                                    "EPS", "DILUTED_EPS","MARGIN","INVENTORY","ASSETS","LIABILITIES","SH_OUT",
                                    "DILUTED_SH_OUT" }, "Financial");
     // Logger::pauseCollection();
     // Renames columns
-    Logger::logTime("Financial", false);
+    timer.stop();
     nameFinancial(financial);
 
     callGC();
@@ -550,6 +554,7 @@ AFDataFrame loadDimSecurity(AFDataFrame &&s_Security, AFDataFrame &dimCompany, A
     // Logger::startCollection();
     Logger::startTimer("DimSecurity");
     {
+        s_Security("PTS").toDate();
         // Logger::startTask("Financial CIK Trim");
         auto cik = s_Security("CO_NAME_OR_CIK").left(1) == "0";
         // Logger::endLastTask();
@@ -557,33 +562,20 @@ AFDataFrame loadDimSecurity(AFDataFrame &&s_Security, AFDataFrame &dimCompany, A
         // Logger::startTask("DimSecurity CIK Join");
         auto part1 = s_Security.select(cik);
         part1("CO_NAME_OR_CIK").cast<unsigned long long>();
-        part1 = part1.equiJoin(
-                dimCompany.project({"SK_CompanyID", "CompanyID", "EffectiveDate", "EndDate"}, "DC"),
-                "CO_NAME_OR_CIK",
-                "CompanyID");
-        part1("PTS").toDate();
+        part1 = part1.asOfJoin(dimCompany.project({"SK_CompanyID", "CompanyID", "EffectiveDate", "EndDate"}, "DC"),
+                               "CO_NAME_OR_CIK", "PTS", "CompanyID", "EffectiveDate", "EndDate");
         part1.nameColumn("EffectiveDate", "PTS");
-        part1 = part1.select(
-                part1("DC.EffectiveDate") <= part1("EffectiveDate") &&
-                part1("DC.EndDate") > part1("EffectiveDate"));
         part1.remove("CO_NAME_OR_CIK");
         part1.remove("DC.CompanyID");
         // Logger::endLastTask();
         // Logger::startTask("DimSecurity Name Join");
         auto part2 = s_Security.select(!cik);
-        part2 = part2.equiJoin(
-                dimCompany.project({"SK_CompanyID", "Name", "EffectiveDate", "EndDate"}, "DC"),
-                "CO_NAME_OR_CIK",
-                "Name");
+        part2 = part2.asOfJoin(dimCompany.project({"SK_CompanyID", "Name", "EffectiveDate", "EndDate"}, "DC"),
+                               "CO_NAME_OR_CIK", "PTS", "Name", "EffectiveDate", "EndDate");
+        part2.nameColumn("EffectiveDate", "PTS");
         part2.remove("CO_NAME_OR_CIK");
         part2.remove("DC.Name");
 
-        part2("PTS").toDate();
-        part2.nameColumn("EffectiveDate", "PTS");
-        part2 = part2.select(
-                part2("DC.EffectiveDate") <= part2("EffectiveDate") &&
-                part2("DC.EndDate") > part2("EffectiveDate"));
-        
         security = part1.unionize(part2);
 
         // Logger::endLastTask();
@@ -604,36 +596,7 @@ AFDataFrame loadDimSecurity(AFDataFrame &&s_Security, AFDataFrame &dimCompany, A
     Logger::logTime("DimSecurity", false);
     nameDimSecurity(security);
     Logger::startTimer("DimSecurity SCD");
-    // Logger::startTask("DimSecurity Update EndDate");
-    auto s0 = security.project({ "SK_SecurityID", "Symbol", "EffectiveDate"}, "S0");
-    s0.sortBy({"Symbol", "EffectiveDate"});
-
-    auto s2 = s0.project({"Symbol"}, "S2");
-    auto s1 = s0.select(range(dim4(s0.rows() - 1), 0, u64) + 1);
-    s2 = s2.select(range(dim4(s2.rows() - 1), 0, u64));
-    s1 = s1.zip(std::move(s2));
-
-    s1 = s1.select(s1("Symbol") == s1("S2.Symbol"));
-    auto end_date = s1.project({ "EffectiveDate" }, "EndDate");
-    if (end_date.isEmpty()) return security;
-
-    s0 = s0.project({ "SK_SecurityID", "Symbol" }, "S0");
-    s1 = s0.project({"Symbol"}, "S1");
-    s0 = s0.select(range(dim4(s0.rows() - 1), 0, u64));
-    s1 = s1.select(range(dim4(s1.rows() - 1), 0, u64) + 1);
-    s0 = s0.zip(std::move(s1));
-
-    s0 = s0.select(s0("Symbol") == s0("S1.Symbol"));
-    s0.project({ "SK_SecurityID" }, "S0");
-    s0 = s0.zip(std::move(end_date));
-
-    s0.nameColumn("EndDate", "EndDate.EffectiveDate");
-    // Logger::startTask("DimSecurity EndDate ID");
-    auto out = AFDataFrame::hashCompare(security("SK_SecurityID"), s0("SK_SecurityID"));
-    security("IsCurrent")(out.first) = 0;
-    security("EndDate")(span, out.first) = (array) s0("EndDate")(span, out.second);
-    // Logger::endLastTask();
-    // Logger::endLastTask();
+    security.applySCD2("Symbol", "EffectiveDate", "SK_SecurityID");
     Logger::logTime("DimSecurity SCD", false);
     // Logger::pauseCollection();
     callGC();
@@ -679,7 +642,7 @@ Column inline marketingNameplate(array const &networth, array const &income, arr
 }
 
 AFDataFrame loadProspect(AFDataFrame &s_Prospect, AFDataFrame &batchDate) {
-    Logger::startTimer("Prospect");
+    Logger::ScopedTimer timer("Prospect");
     AFDataFrame prospect(std::move(s_Prospect));
 
     auto dim = prospect("Age").dims();
@@ -687,7 +650,7 @@ AFDataFrame loadProspect(AFDataFrame &s_Prospect, AFDataFrame &batchDate) {
     prospect.name("Prospect");
 
     auto col = Column(tile(batchDate(1)(span, batchDate(0).data() == batchID), dim), DATE);
-    prospect.insert(Column(col.hash()), 1, "SK_RecordDateID");
+    prospect.insert(Column(col.dateKey()), 1, "SK_RecordDateID");
     prospect.insert(Column(array(prospect("SK_RecordDateID").data())), 2, "SK_UpdateDateID");
     prospect.insert(Column(constant(1, dim, u32)), 3, "BatchID");
     prospect.insert(Column(constant(0, dim, b8)), 4, "IsCustomer");
@@ -698,15 +661,14 @@ AFDataFrame loadProspect(AFDataFrame &s_Prospect, AFDataFrame &batchDate) {
                                   prospect("CreditRating").data(),
                                   prospect("NumberCars").data());
     prospect.add(std::move(tmp), "MarketingNameplate");
-    Logger::logTime("Prospect", false);
     return prospect;
 }
 
-AFDataFrame loadStagingTrade(char const* directory) {
+AFDataFrame loadStagingTrade(char const* directory, bool const isIncremental) {
     char file[128];
     strcpy(file, directory);
     strcat(file, "Trade.txt");
-    Logger::startTimer("StagingTrade");
+    Logger::ScopedTimer timer("StagingTrade");
     AFDataFrame frame;
     // Logger::startCollection();
 
@@ -715,23 +677,26 @@ AFDataFrame loadStagingTrade(char const* directory) {
     // Logger::endLastTask();
 
     // Logger::startTask("Trade Parse");
-    frame.add(parser.parse<unsigned long long>(0));
-    frame.add(parser.asDateTime(1, YYYYMMDD));
-    frame.add(parser.parse<char*>(2));
-    frame.add(parser.parse<char*>(3));
-    frame.add(parser.parse<bool>(4));
-    frame.add(parser.parse<char*>(5));
-    frame.add(parser.parse<unsigned int>(6));
-    callGC();
-    frame.add(parser.parse<double>(7));
-    frame.add(parser.parse<unsigned int>(8));
-    frame.add(parser.parse<unsigned long long>(9));
-    frame.add(parser.parse<double>(10));
-    frame.add(parser.parse<double>(11));
-    frame.add(parser.parse<double>(12));
-    frame.add(parser.parse<double>(13));
+    // Incremental batches prefix every record with CDC_FLAG and CDC_DSN, the flag is kept as the last column
+    auto const c = isIncremental ? 2 : 0;
+    frame.add(parser.parse<unsigned long long>(c));
+    frame.add(parser.asDateTime(c + 1, YYYYMMDD));
+    frame.add(parser.parse<char*>(c + 2));
+    frame.add(parser.parse<char*>(c + 3));
+    frame.add(parser.parse<bool>(c + 4));
+    frame.add(parser.parse<char*>(c + 5));
+    frame.add(parser.parse<unsigned int>(c + 6));
+    callGC();
+    frame.add(parser.parse<double>(c + 7));
+    frame.add(parser.parse<unsigned int>(c + 8));
+    frame.add(parser.parse<char*>(c + 9));
+    frame.add(parser.parse<double>(c + 10));
+    frame.add(parser.parse<double>(c + 11));
+    frame.add(parser.parse<double>(c + 12));
+    frame.add(parser.parse<double>(c + 13));
+    if (isIncremental) frame.add(parser.parse<char*>(0));
     // Logger::endLastTask();
-    Logger::logTime("StagingTrade", false);
+    timer.stop();
     // Logger::pauseCollection();
     callGC();
     return frame;
@@ -741,7 +706,7 @@ AFDataFrame loadStagingTradeHistory(char const* directory) {
     char file[128];
     strcpy(file, directory);
     strcat(file, "TradeHistory.txt");
-    Logger::startTimer("StagingTradeHistory");
+    Logger::ScopedTimer timer("StagingTradeHistory");
     AFDataFrame frame;
     // Logger::startCollection();
 
@@ -754,12 +719,71 @@ AFDataFrame loadStagingTradeHistory(char const* directory) {
     frame.add(parser.asDateTime(1, YYYYMMDD));
     frame.add(parser.parse<char*>(2));
     // Logger::endLastTask();
-    Logger::logTime("StagingTradeHistory", false);
+    timer.stop();
     // Logger::pauseCollection();
     callGC();
     return frame;
 }
 
+AFDataFrame loadStagingHoldings(char const* directory, bool const isIncremental) {
+    char file[128];
+    strcpy(file, directory);
+    strcat(file, "HoldingHistory.txt");
+    AFDataFrame frame;
+    auto const c = isIncremental ? 2 : 0;
+    Schema const schema = {{c, ULONG}, {c + 1, ULONG}, {c + 2, UINT}, {c + 3, UINT}};
+    StagingCache::Key const key("StagingHoldings", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("StagingHoldings");
+    AFParser parser(file, '|', false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
+    callGC();
+    StagingCache::store(key, frame);
+    return frame;
+}
+
+/* Customer.txt of an incremental batch, laid out like the CustomerMgmt staging frame so the same customer actions
+ * apply. Its records carry no timestamp, C_ST_ID takes the place of the action timestamp */
+AFDataFrame loadStagingIncrementalCustomer(char const* directory) {
+    char file[128];
+    strcpy(file, directory);
+    strcat(file, "Customer.txt");
+    AFDataFrame frame;
+    Schema schema = {{0, STRING}, {4, STRING}, {2, ULONG}, {3, STRING}, {8, STRING}, {9, UCHAR}, {10, DATE}};
+    addFields(schema, 5, 7, STRING);
+    addFields(schema, 11, 16, STRING);
+    addFields(schema, 29, 30, STRING);
+    addFields(schema, 17, 28, STRING);
+    addFields(schema, 31, 32, STRING);
+    StagingCache::Key const key("StagingIncrementalCustomer", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("StagingIncrementalCustomer");
+    AFParser parser(file, '|', false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
+    callGC();
+    StagingCache::store(key, frame);
+    return frame;
+}
+
+AFDataFrame loadStagingAccount(char const* directory) {
+    char file[128];
+    strcpy(file, directory);
+    strcat(file, "Account.txt");
+    AFDataFrame frame;
+    Schema const schema = {{2, ULONG}, {3, ULONG}, {4, ULONG}, {5, STRING}, {6, USHORT}, {7, STRING}};
+    StagingCache::Key const key("StagingAccount", {file}, AFParser::describe(schema));
+    if (StagingCache::fetch(key, frame)) return frame;
+    Logger::ScopedTimer timer("StagingAccount");
+    AFParser parser(file, '|', false);
+    parseSchema(parser, schema, frame);
+    timer.stop();
+    callGC();
+    StagingCache::store(key, frame);
+    return frame;
+}
+
 Customer splitCustomer(AFDataFrame &&s_Customer) {
     auto idx = s_Customer(0) == "NEW";
     auto newC = new AFDataFrame(s_Customer.select(idx));
@@ -777,115 +801,779 @@ Customer splitCustomer(AFDataFrame &&s_Customer) {
     return Customer(newC, add, uAcc, cAcc, uCus, inAc);
 }
 
-#ifdef CUSTOMER
-inline Column phoneNumberProcessing(Column const &ctry, Column const &area, Column const &local, Column const &ext) {
-    auto const cond1 = where(ctry.irow(1) && area.irow(1) && local.irow(1));
-    auto const cond2 = where(ctry.irow(1) == 0 &&  area.irow(1) && local.irow(1));
-    auto const cond3 = where(area.irow(1) == 0 && local.irow(1));
-    auto const extNotNull = where(ext.irow(1));
-    auto const c = 3;
-    auto const a = 3;
-    auto const l = 10;
-    auto const e = 5;
-
-    auto out = constant(0, dim4(c + a + l + e + 4, ctry.length()), u8);
-    out(0, cond1) = '+';
-    auto idx = range(dim4(c), 0, u32) + 1;
-    idx = batchFunc(idx, hflat(cond1) * out.dims(0) , BatchFunctions::batchAdd);
-    out(idx) = flat(ctry(span, cond1));
-
-    auto j = join(0, cond1, cond2);
-    out(c + 1, j) = '(';
-    idx = range(dim4(a), 0, u32) + c + 2;
-    idx = batchFunc(idx, hflat(j) * out.dims(0) , BatchFunctions::batchAdd);
-    out(idx) = flat(area(span, j));
-    out(2 + c + a, j) = ')';
-
-    j = join(0, j, cond3);
-    idx = range(dim4(l), 0, u32) + c + a + 3;
-    idx = batchFunc(idx, hflat(j) * out.dims(0) , BatchFunctions::batchAdd);
-    out(idx) = flat(local(span, j));
-
-    j = join(0, j, extNotNull);
-    idx = range(dim4(e), 0, u32) + c + a + l + 3;
-    idx = batchFunc(idx, hflat(j) * out.dims(0) , BatchFunctions::batchAdd);
-    out(idx) = flat(ext(span, j));
-
-    out(3 + c + a + l + e, span) = '\n';
-
-    out = out(where(out)).as(u32);
-    idx = hflat(where(out == '\n'));
-    out(idx) = 0;
-    auto tmp = join(1, constant(0, 1, u32), idx.cols(0, end - 1) + 1);
-    idx = join(0, tmp, idx);
-    auto h = sum<uint32_t>(max(diff1(idx, 0))) + 1;
-    tmp = batchFunc(idx.row(0), range(dim4(h), 0, u32), BatchFunctions::batchAdd);
-    tmp(where(batchFunc(tmp, idx.row(1), BatchFunctions::batchGreater))) = UINT32_MAX;
-    idx = where(tmp != UINT32_MAX);
-    tmp(idx) = out;
-    out = tmp;
-    out(where(out == UINT32_MAX)) = 0;
-    out = moddims(out, dim4(h, out.elements() / h)).as(u8);
-    out.eval();
-
-    idx = af::diff1(af::join(1, af::constant(0, 1, u64), hflat(where64(out == 0))), 1);
-    idx(0) += 1;
-    idx = join(0, af::scan(idx, 1, AF_BINARY_ADD, false), idx);
-    return Column(out, idx);
+static Column stringConstant(char const *text, dim_t const rows) {
+    array word(dim4(strlen(text) + 1), (unsigned char const *) text);
+    return Column(flat(tile(word, dim4(1, rows))), STRING);
 }
 
-AFDataFrame loadDimCustomer(Customer &s_Customer, AFDataFrame &taxRate, AFDataFrame &prospect) {
-    std::pair<int, char const*> input[] = {
-            {2, "CustomerID"},
-            {3, "TaxID"},
-            {7, "LastName"},
-            {8, "FirstName"},
-            {9, "MiddleInitial"},
-            {4, "Gender"},
-            {5, "Tier"},
-            {6, "DOB"},
-            {10, "AddressLine1"},
-            {11, "AddressLine2"},
-            {12, "PostalCode"},
-            {13, "City"},
-            {14, "StateProvince"},
-            {15, "Country"},
-            {16, "Email1"},
-            {17, "Email2"}
+/* Account columns of a set of CustomerMgmt actions. Inherit marks rows that only change the status and take
+ * every other attribute from the account's previous row */
+static AFDataFrame accountActions(AFDataFrame &actions, char const *status, bool const inherit) {
+    AFDataFrame frame;
+    if (actions.isEmpty()) return frame;
+    auto const rows = actions.rows();
+    frame.add(actions(32), "AccountID");
+    frame.add(actions(34), "BrokerID");
+    frame.add(actions(2), "CustomerID");
+    frame.add(stringConstant(status, rows), "Status");
+    frame.add(actions(35), "AccountDesc");
+    frame.add(actions(33), "TaxStatus");
+    frame.add(actions(1), "ActionTS");
+    frame.add(Column(constant(inherit, dim4(1, rows), b8)), "Inherit");
+    return frame;
+}
+
+/* Row segments of a frame sorted by key, numbered from 1, and the 1-based position of every row */
+static std::pair<array, array> keySegments(array const &key) {
+    auto const rows = key.elements();
+    auto starts = constant(1, dim4(1, rows), u32);
+    if (rows > 1) starts(0, seq(1, rows - 1)) = (key(0, seq(1, rows - 1)) != key(0, seq(0, rows - 2))).as(u32);
+    return {accum(starts, 1), range(dim4(1, rows), 1, u32) + 1};
+}
+
+/* Index of the latest row at or before each row, within its segment, whose value is present */
+static array latestPresent(std::pair<array, array> const &segments, array const &missing) {
+    auto const &position = segments.second;
+    auto last = scanByKey(segments.first, position * (!missing).as(u32), 1, AF_BINARY_MAX);
+    last += (last == 0).as(u32) * position;
+    return hflat(last - 1);
+}
+
+/* Fills the attributes an action left out with the value from the latest earlier row of the same account.
+ * Expects the frame sorted by AccountID and ActionTS */
+static void inheritAccountFields(AFDataFrame &account) {
+    auto const segments = keySegments(account("AccountID").data());
+    array const inherit = account("Inherit").data();
+    auto const source = [&segments](array const &missing) { return latestPresent(segments, missing); };
+    account("BrokerID") = account("BrokerID").select(source(inherit || account("BrokerID").data() == 0));
+    account("CustomerID") = account("CustomerID").select(source(account("CustomerID").data() == 0));
+    account("AccountDesc") = account("AccountDesc").select(source(inherit || account("AccountDesc").irow(1) <= 1));
+    account("TaxStatus") = account("TaxStatus").select(source(inherit));
+}
+
+AFDataFrame loadDimAccount(Customer &s_Customer) {
+    Logger::ScopedTimer timer("DimAccount");
+    auto added = accountActions(*s_Customer.newCust, "Active", false);
+    auto opened = accountActions(*s_Customer.addAcct, "Active", false);
+    auto updated = accountActions(*s_Customer.updAcct, "Active", false);
+    auto closed = accountActions(*s_Customer.closeAcct, "Inactive", true);
+
+    // Inactivating a customer closes every account it opened
+    AFDataFrame inactive;
+    AFDataFrame owners;
+    for (auto frame : {&added, &opened}) {
+        if (frame->isEmpty()) continue;
+        auto pairs = frame->project({"AccountID", "CustomerID"}, "Owners");
+        owners = owners.isEmpty() ? pairs : owners.unionize(pairs);
+    }
+    if (!s_Customer.inact->isEmpty() && !owners.isEmpty()) {
+        AFDataFrame inact;
+        inact.add((*s_Customer.inact)(2), "CustomerID");
+        inact.add((*s_Customer.inact)(1), "ActionTS");
+        inact = inact.equiJoin(owners, "CustomerID", "CustomerID");
+        if (!inact.isEmpty()) {
+            auto const rows = inact.rows();
+            inactive.add(inact("Owners.AccountID"), "AccountID");
+            inactive.add(Column(constant(0, dim4(1, rows), u64)), "BrokerID");
+            inactive.add(inact("CustomerID"), "CustomerID");
+            inactive.add(stringConstant("Inactive", rows), "Status");
+            inactive.add(stringConstant("", rows), "AccountDesc");
+            inactive.add(Column(constant(0, dim4(1, rows), u16)), "TaxStatus");
+            inactive.add(inact("ActionTS"), "ActionTS");
+            inactive.add(Column(constant(1, dim4(1, rows), b8)), "Inherit");
+        }
+    }
+
+    AFDataFrame account;
+    for (auto frame : {&added, &opened, &updated, &closed, &inactive}) {
+        if (frame->isEmpty()) continue;
+        account = account.isEmpty() ? *frame : account.unionize(*frame);
+    }
+    account.name("DimAccount");
+    if (account.isEmpty()) return account;
+
+    account.sortBy({"AccountID", "ActionTS"});
+    inheritAccountFields(account);
+    account.remove("Inherit");
+    account("ActionTS").toDate();
+    account.nameColumn("EffectiveDate", "ActionTS");
+
+    auto const rows = account.rows();
+    account.insert(Column(range(dim4(1, rows), 1, u64)), 0, "SK_AccountID");
+    account.insert(Column(constant(1, dim4(1, rows), b8)), account.columns() - 1, "IsCurrent");
+    account.insert(Column(constant(1, dim4(1, rows), u32)), account.columns() - 1, "BatchID");
+    account.add(Utils::endDate(rows), "EndDate");
+    timer.stop();
+
+    Logger::startTimer("DimAccount SCD");
+    account.applySCD2("AccountID", "EffectiveDate", "SK_AccountID");
+    Logger::logTime("DimAccount SCD", false);
+    callGC();
+    return account;
+}
+
+/* Formats the country, area, local and extension parts of each row into one phone string. The four columns are
+ * laid end to end so a single kernel can measure and write every row */
+static Column phoneNumberProcessing(Column const &ctry, Column const &area, Column const &local, Column const &ext) {
+    auto const input = join(0, flat(ctry.data()), flat(area.data()), flat(local.data()), flat(ext.data()));
+    array parts;
+    unsigned long long offset = 0;
+    for (auto const part : {&ctry, &area, &local, &ext}) {
+        array idx = part->index();
+        idx.row(0) += offset;
+        parts = parts.isempty() ? idx : join(0, parts, idx);
+        offset += part->data().elements();
+    }
+    array idx;
+    auto out = phoneFormat(input, parts, idx);
+    return Column(std::move(out), std::move(idx));
+}
+
+/* Row of the dictionary holding each key, or the dictionary size where the key is absent. Keys and dictionary
+ * are sorted together, dictionary entries first, so each key picks up the entry sharing its segment */
+static array dictionaryLookup(array const &keys, array const &dictionary) {
+    auto const size = dictionary.elements();
+    auto const rows = keys.elements();
+    array sorted;
+    array order;
+    sort(sorted, order, join(1, hflat(dictionary), hflat(keys)), 1);
+    auto const segments = keySegments(sorted);
+    auto entry = (order < size).as(u32) * (order + 1);
+    entry = scanByKey(segments.first, entry, 1, AF_BINARY_MAX);
+    auto found = constant(0, dim4(1, rows), u32);
+    auto const isKey = order >= size;
+    found(order(isKey) - size) = entry(isKey);
+    found(found == 0) = size + 1;
+    return found - 1;
+}
+
+/* Selects rows of a dictionary column, rows past its end give an empty string or zero */
+static Column dictionaryColumn(Column const &column, array const &rows) {
+    auto const padding = column.type() == STRING ? stringConstant("", 1)
+                                                 : Column(constant(0, dim4(1, 1), column.data().type()), column.type());
+    return column.concatenate(padding).select(rows);
+}
+
+/* Hash of the upper-cased strings, prospects are matched to customers regardless of case */
+static array upperHash(Column const &column) {
+    array data = column.data();
+    data -= (data >= 'a' && data <= 'z').as(u8) * 32;
+    return Column(data, column.index()).hash();
+}
+
+static array customerKey(AFDataFrame &frame) {
+    array key;
+    for (auto const name : {"LastName", "FirstName", "AddressLine1", "AddressLine2", "PostalCode"}) {
+        auto const hash = upperHash(frame(name));
+        key = key.isempty() ? hash : (key * 0x100000001b3llU) ^ hash;
+    }
+    return key;
+}
+
+/* M and F in either case are kept, anything else becomes U */
+static Column normalizeGender(Column const &gender) {
+    auto const rows = gender.length();
+    array first = gender.data()(gender.irow(0));
+    first -= (first >= 'a' && first <= 'z').as(u8) * 32;
+    first = hflat(select(first == 'M' || first == 'F', first, (double)'U'));
+    auto data = flat(join(0, first, constant(0, dim4(1, rows), u8)));
+    auto idx = join(0, range(dim4(1, rows), 1, u64) * 2, constant(2, dim4(1, rows), u64));
+    return Column(std::move(data), std::move(idx));
+}
+
+/* Customer columns of a set of CustomerMgmt actions, phones are kept as their four parts until formatted.
+ * Inherit marks rows that only change the status and take every other attribute from the previous row */
+static AFDataFrame customerActions(AFDataFrame &actions, char const *status, bool const inherit) {
+    AFDataFrame frame;
+    if (actions.isEmpty()) return frame;
+    auto const rows = actions.rows();
+    std::pair<int, char const*> const input[] = {
+            {2, "CustomerID"}, {3, "TaxID"}, {7, "LastName"}, {8, "FirstName"}, {9, "MiddleInitial"}, {4, "Gender"},
+            {5, "Tier"}, {6, "DOB"}, {10, "AddressLine1"}, {11, "AddressLine2"}, {12, "PostalCode"}, {13, "City"},
+            {14, "StateProv"}, {15, "Country"}, {16, "Email1"}, {17, "Email2"}, {31, "NationalTaxID"},
+            {30, "LocalTaxID"}, {1, "ActionTS"}
     };
-    auto &frame = *s_Customer.newCust;
-    auto dim = frame.column(2).dims();
+    for (auto const &i : input) frame.add(actions(i.first), i.second);
+    for (int i = 18; i < 30; ++i) frame.add(actions(i), "PhonePart" + std::to_string(i - 18));
+    frame.add(stringConstant(status, rows), "Status");
+    frame.add(Column(constant(inherit, dim4(1, rows), b8)), "Inherit");
+    return frame;
+}
+
+/* Fills the attributes an update left empty with the value from the latest earlier row of the same customer.
+ * Expects the frame sorted by CustomerID and ActionTS */
+static void inheritCustomerFields(AFDataFrame &customer) {
+    auto const segments = keySegments(customer("CustomerID").data());
+    array const inherit = customer("Inherit").data();
+    for (auto const name : {"TaxID", "LastName", "FirstName", "MiddleInitial", "Gender", "Tier", "DOB",
+                            "AddressLine1", "AddressLine2", "PostalCode", "City", "StateProv", "Country", "Phone1",
+                            "Phone2", "Phone3", "Email1", "Email2", "NationalTaxID", "LocalTaxID"}) {
+        auto &column = customer(name);
+        // Parsed columns mark empty fields null, their stored value is no sentinel (an empty DOB is not day 0)
+        auto const missing = column.type() == STRING ? column.irow(1) <= 1 : !column.isValid();
+        column = column.select(latestPresent(segments, inherit || missing));
+    }
+}
+
+/* Replaces the four parts of each phone with the formatted number */
+static void formatPhones(AFDataFrame &customer) {
+    for (int i = 0; i < 3; ++i) {
+        auto const part = [&customer, i](int const k) -> Column& {
+            return customer("PhonePart" + std::to_string(4 * i + k));
+        };
+        customer.add(phoneNumberProcessing(part(0), part(1), part(2), part(3)), "Phone" + std::to_string(i + 1));
+    }
+    for (int i = 11; i >= 0; --i) customer.remove("PhonePart" + std::to_string(i));
+}
+
+/* DimCustomer rows of complete customer versions, each effective on its ActionTS date. Surrogate keys are numbered
+ * from 1 and no history is resolved */
+static AFDataFrame customerDimension(AFDataFrame &customer, AFDataFrame &taxRate, AFDataFrame &prospect,
+                                     unsigned int const batchID) {
     AFDataFrame dimCustomer;
     dimCustomer.name("DimCustomer");
-    for (auto const &i: input) dimCustomer.add(std::move(frame.column(i.first)), i.second);
+    customer("Gender") = normalizeGender(customer("Gender"));
+    auto const rows = customer.rows();
+    dimCustomer.add(Column(range(dim4(1, rows), 1, u64)), "SK_CustomerID");
+    for (auto const name : {"CustomerID", "TaxID", "Status", "LastName", "FirstName", "MiddleInitial", "Gender", "Tier",
+                            "DOB", "AddressLine1", "AddressLine2", "PostalCode", "City", "StateProv", "Country",
+                            "Phone1", "Phone2", "Phone3", "Email1", "Email2"}) {
+        dimCustomer.add(customer(name), name);
+    }
+
+    // TaxRate is a small dictionary, each customer row is resolved against it without a join
+    auto const taxID = taxRate("TX_ID").hash();
+    auto rates = dictionaryLookup(customer("NationalTaxID").hash(), taxID);
+    dimCustomer.add(dictionaryColumn(taxRate("TX_NAME"), rates), "NationalTaxRateDesc");
+    dimCustomer.add(dictionaryColumn(taxRate("TX_RATE"), rates), "NationalTaxRate");
+    rates = dictionaryLookup(customer("LocalTaxID").hash(), taxID);
+    dimCustomer.add(dictionaryColumn(taxRate("TX_NAME"), rates), "LocalTaxRateDesc");
+    dimCustomer.add(dictionaryColumn(taxRate("TX_RATE"), rates), "LocalTaxRate");
+
+    auto const matches = dictionaryLookup(customerKey(customer), customerKey(prospect));
+    for (auto const name : {"AgencyID", "CreditRating", "NetWorth", "MarketingNameplate"}) {
+        dimCustomer.add(dictionaryColumn(prospect(name), matches), name);
+    }
 
-    dimCustomer.insert(Column(tile(array(dim4(7), "ACTIVE"), dim), STRING), 2, "Status");
+    dimCustomer.add(Column(constant(1, dim4(1, rows), b8)), "IsCurrent");
+    dimCustomer.add(Column(constant(batchID, dim4(1, rows), u32)), "BatchID");
+    dimCustomer.add(customer("ActionTS"), "EffectiveDate");
+    dimCustomer.add(Utils::endDate(rows), "EndDate");
+    return dimCustomer;
+}
 
-    dimCustomer.insert(Column(phoneNumberProcessing(frame.column(18).data(), frame.column(19).data(),
-                                                    frame.column(20).data(), frame.column(21).data()), 15, "Phone1");
-    dimCustomer.insert(Column(phoneNumberProcessing(frame.column(22).data(), frame.column(23).data(),
-                                                    frame.column(24).data(), frame.column(25).data()), 16, "Phone2");
-    dimCustomer.insert(Column(phoneNumberProcessing(frame.column(26).data(), frame.column(27).data(),
-                                                    frame.column(28).data(), frame.column(29).data()), 17, "Phone3");
-    {
-        AFDataFrame tmp;
-        tmp.name("NationalTax");
-        tmp.add(Column(frame.column(31)), "ID");
-        tmp = tmp.equiJoin(taxRate, "ID", "TX_ID");
-        dimCustomer.add(tmp.column("TaxRate.TX_NAME"), "NationalTaxRateDesc");
-        dimCustomer.add(tmp.column("TaxRate.TX_NAME"), "NationalTaxRate");
+AFDataFrame loadDimCustomer(Customer &s_Customer, AFDataFrame &taxRate, AFDataFrame &prospect) {
+    Logger::ScopedTimer timer("DimCustomer");
+    auto added = customerActions(*s_Customer.newCust, "Active", false);
+    auto updated = customerActions(*s_Customer.updCust, "Active", false);
+    auto inactive = customerActions(*s_Customer.inact, "Inactive", true);
+
+    AFDataFrame customer;
+    for (auto frame : {&added, &updated, &inactive}) {
+        if (frame->isEmpty()) continue;
+        customer = customer.isEmpty() ? *frame : customer.unionize(*frame);
+    }
+    if (customer.isEmpty()) {
+        AFDataFrame dimCustomer;
+        dimCustomer.name("DimCustomer");
+        return dimCustomer;
+    }
+    customer.sortBy({"CustomerID", "ActionTS"});
+
+    formatPhones(customer);
+    inheritCustomerFields(customer);
+    customer("ActionTS").toDate();
+    auto dimCustomer = customerDimension(customer, taxRate, prospect, 1);
+    customer.clear();
+    timer.stop();
+
+    Logger::startTimer("DimCustomer SCD");
+    dimCustomer.applySCD2("CustomerID", "EffectiveDate", "SK_CustomerID");
+    Logger::logTime("DimCustomer SCD", false);
+    callGC();
+    return dimCustomer;
+}
+
+
+/* Joins each row to the version of an SCD dimension in effect on its date. The first of columns is the dimension's
+ * join key, the chosen columns come back prefixed with name */
+static AFDataFrame joinEffective(AFDataFrame const &frame, std::string const &key, std::string const &date,
+                                 AFDataFrame const &dimension, std::initializer_list<std::string> columns,
+                                 std::string const &name) {
+    std::vector<std::string> projection(columns);
+    projection.emplace_back("EffectiveDate");
+    projection.emplace_back("EndDate");
+    auto const versions = dimension.project(projection.data(), (int)projection.size(), name);
+    return frame.asOfJoin(versions, key, date, *columns.begin(), "EffectiveDate", "EndDate");
+}
+
+/* Basic EPS summed over each company's latest four quarters, with its company and quarter packed into one key */
+static std::pair<array, array> rollingEarnings(AFDataFrame const &financial) {
+    auto fin = financial.project({"SK_CompanyID", "FI_YEAR", "FI_QTR", "FI_BASIC_EPS"}, "FI");
+    fin.sortBy({"SK_CompanyID", "FI_YEAR", "FI_QTR"});
+    auto const rows = fin.rows();
+    array const company = fin("SK_CompanyID").data().as(u64);
+    array const quarter = fin("FI_YEAR").data().as(u64) * 4 + fin("FI_QTR").data().as(u64) - 1;
+    auto const segments = keySegments(company);
+    array const total = scanByKey(segments.first, fin("FI_BASIC_EPS").data().as(f64), 1, AF_BINARY_ADD);
+    auto earlier = constant(0, dim4(1, rows), f64);
+    if (rows > 4) {
+        auto const same = segments.first(0, seq(4, rows - 1)) == segments.first(0, seq(0, rows - 5));
+        earlier(0, seq(4, rows - 1)) = total(0, seq(0, rows - 5)) * same;
+    }
+    return {(company << 20) | quarter, total - earlier};
+}
+
+AFDataFrame loadFactMarketHistory(AFDataFrame &&s_Market, AFDataFrame &dimSecurity, AFDataFrame &dimDate,
+                                  AFDataFrame &financial) {
+    Logger::ScopedTimer timer("FactMarketHistory");
+    AFDataFrame fact;
+    fact.name("FactMarketHistory");
+    AFDataFrame market(std::move(s_Market));
+    if (market.isEmpty()) return fact;
+
+    // The 52 weeks are taken as the year up to and including the trading day
+    Logger::startTimer("FactMarketHistory Window");
+    market.rangeWindow("DM_S_SYMB", "DM_DATE", "DM_HIGH", 365, true, "FiftyTwoWeekHigh");
+    market.rangeWindow("DM_S_SYMB", "DM_DATE", "DM_LOW", 365, false, "FiftyTwoWeekLow");
+    Logger::logTime("FactMarketHistory Window", false);
+
+    market = joinEffective(market, "DM_S_SYMB", "DM_DATE", dimSecurity,
+                           {"Symbol", "SK_SecurityID", "SK_CompanyID", "Dividend"}, "DS");
+    if (market.isEmpty()) return fact;
+    auto const rows = market.rows();
+
+    auto const dateValue = dimDate(1).hash();
+    auto const dateID = [&market, &dimDate, &dateValue](std::string const &name) {
+        return dictionaryColumn(dimDate(0), dictionaryLookup(market(name).hash(), dateValue));
+    };
+
+    // PE ratio against the four quarters before the trading day's quarter, NaN where there are no earnings
+    array const close = market("DM_CLOSE").data().as(f64);
+    auto earnings = constant(0, dim4(1, rows), f64);
+    if (!financial.isEmpty()) {
+        auto const rolling = rollingEarnings(financial);
+        array const day = market("DM_DATE").dateKey();
+        array const previous = day / 10000 * 4 + (day / 100 % 100 - 1) / 3 - 1;
+        auto const key = (market("DS.SK_CompanyID").data().as(u64) << 20) | previous;
+        earnings = dictionaryColumn(Column(rolling.second), dictionaryLookup(key, rolling.first)).data();
+    }
+    auto const peRatio = af::select(earnings != 0, close / earnings, af::NaN);
+    auto const yield = market("DS.Dividend").data().as(f64) / close * 100;
+
+    fact.add(market("DS.SK_SecurityID"), "SK_SecurityID");
+    fact.add(market("DS.SK_CompanyID"), "SK_CompanyID");
+    fact.add(dateID("DM_DATE"), "SK_DateID");
+    fact.add(Column(peRatio), "PERatio");
+    fact.add(Column(yield), "Yield");
+    fact.add(market("FiftyTwoWeekHigh"), "FiftyTwoWeekHigh");
+    fact.add(dateID("FiftyTwoWeekHighDate"), "SK_FiftyTwoWeekHighDate");
+    fact.add(market("FiftyTwoWeekLow"), "FiftyTwoWeekLow");
+    fact.add(dateID("FiftyTwoWeekLowDate"), "SK_FiftyTwoWeekLowDate");
+    fact.add(market("DM_CLOSE"), "ClosePrice");
+    fact.add(market("DM_HIGH"), "DayHigh");
+    fact.add(market("DM_LOW"), "DayLow");
+    fact.add(market("DM_VOL"), "Volume");
+    fact.add(Column(constant(1, dim4(1, rows), u32)), "BatchID");
+    timer.stop();
+    callGC();
+    return fact;
+}
+
+/* Surrogate key of each value through a dimension's business and surrogate key columns, zero where it is absent */
+static Column dimensionKey(Column const &key, Column const &dimensionKey, Column const &surrogate) {
+    return dictionaryColumn(surrogate, dictionaryLookup(key.hash(), dimensionKey.hash()));
+}
+
+static Column datePart(Column const &dateTime) {
+    Column date(dateTime);
+    date.toDate();
+    return date;
+}
+
+static Column timePart(Column const &dateTime) {
+    Column time(dateTime);
+    time.toTime();
+    return time;
+}
+
+/* Timestamp of the earliest or latest history row of each trade among the given statuses, zero where there is none */
+static Column tradeTimestamp(AFDataFrame &history, AFDataFrame &trade, std::initializer_list<char const*> statuses,
+                             bool const latest) {
+    auto keep = constant(0, dim4(1, history.rows()), b8);
+    for (auto const status : statuses) keep = keep || history("TH_ST_ID") == status;
+    auto rows = history.select(keep);
+    if (rows.isEmpty()) return Column(constant(0, dim4(1, trade.rows()), s64), DATETIME);
+    rows.sortBy({"TH_T_ID", "TH_DTS"}, {true, latest});
+    return dictionaryColumn(rows("TH_DTS"), dictionaryLookup(trade("TradeID").hash(), rows("TH_T_ID").hash()));
+}
+
+static void nameTrade(AFDataFrame &trade) {
+    char const *names[] = {"TradeID", "T_DTS", "T_ST_ID", "T_TT_ID", "CashFlag", "T_S_SYMB", "Quantity", "BidPrice",
+                           "T_CA_ID", "ExecutedBy", "TradePrice", "Fee", "Commission", "Tax"};
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(*names); ++i) trade.nameColumn(names[i], i);
+    trade.name("Trade");
+}
+
+AFDataFrame loadDimTrade(AFDataFrame &&s_Trade, AFDataFrame &&s_TradeHistory, AFDataFrame &statusType,
+                         AFDataFrame &tradeType, AFDataFrame &dimAccount, AFDataFrame &dimSecurity,
+                         AFDataFrame &dimCustomer, AFDataFrame &dimBroker, AFDataFrame &dimDate, AFDataFrame &dimTime) {
+    Logger::ScopedTimer timer("DimTrade");
+    AFDataFrame trade(std::move(s_Trade));
+    AFDataFrame history(std::move(s_TradeHistory));
+    AFDataFrame dimTrade;
+    dimTrade.name("DimTrade");
+    if (trade.isEmpty()) return dimTrade;
+    nameTrade(trade);
+    history.nameColumn("TH_T_ID", 0);
+    history.nameColumn("TH_DTS", 1);
+    history.nameColumn("TH_ST_ID", 2);
+
+    // Submitted or pending opens a trade, completed or cancelled closes it
+    auto const created = tradeTimestamp(history, trade, {"SBMT", "PNDG"}, false);
+    auto const closed = tradeTimestamp(history, trade, {"CMPT", "CNCL"}, true);
+    history.clear();
+    trade.add(datePart(created), "CreateDate");
+    trade.add(dimensionKey(trade("CreateDate"), dimDate(1), dimDate(0)), "SK_CreateDateID");
+    trade.add(dimensionKey(timePart(created), dimTime(1), dimTime(0)), "SK_CreateTimeID");
+    trade.add(dimensionKey(datePart(closed), dimDate(1), dimDate(0)), "SK_CloseDateID");
+    trade.add(dimensionKey(timePart(closed), dimTime(1), dimTime(0)), "SK_CloseTimeID");
+    trade.add(dimensionKey(trade("T_ST_ID"), statusType("ST_ID"), statusType("ST_NAME")), "Status");
+    trade.add(dimensionKey(trade("T_TT_ID"), tradeType(0), tradeType(1)), "Type");
+    trade("T_CA_ID").cast<unsigned long long>();
+
+    trade = joinEffective(trade, "T_S_SYMB", "CreateDate", dimSecurity, {"Symbol", "SK_SecurityID", "SK_CompanyID"},
+                          "DS");
+    trade = joinEffective(trade, "T_CA_ID", "CreateDate", dimAccount,
+                          {"AccountID", "SK_AccountID", "CustomerID", "BrokerID"}, "DA");
+    trade = joinEffective(trade, "DA.CustomerID", "CreateDate", dimCustomer, {"CustomerID", "SK_CustomerID"}, "DC");
+    if (trade.isEmpty()) return dimTrade;
+    auto const rows = trade.rows();
+
+    dimTrade.add(trade("TradeID"), "TradeID");
+    dimTrade.add(dimensionKey(trade("DA.BrokerID"), dimBroker(1), dimBroker(0)), "SK_BrokerID");
+    for (auto const name : {"SK_CreateDateID", "SK_CreateTimeID", "SK_CloseDateID", "SK_CloseTimeID", "Status",
+                            "Type", "CashFlag"}) {
+        dimTrade.add(trade(name), name);
     }
+    dimTrade.add(trade("DS.SK_SecurityID"), "SK_SecurityID");
+    dimTrade.add(trade("DS.SK_CompanyID"), "SK_CompanyID");
+    dimTrade.add(trade("Quantity"), "Quantity");
+    dimTrade.add(trade("BidPrice"), "BidPrice");
+    dimTrade.add(trade("DC.SK_CustomerID"), "SK_CustomerID");
+    dimTrade.add(trade("DA.SK_AccountID"), "SK_AccountID");
+    for (auto const name : {"ExecutedBy", "TradePrice", "Fee", "Commission", "Tax"}) dimTrade.add(trade(name), name);
+    dimTrade.add(Column(constant(1, dim4(1, rows), u32)), "BatchID");
+    timer.stop();
+    callGC();
+    return dimTrade;
+}
+
+/* Marks the last row of each run of equal keys in a sorted key row */
+static array lastOfRuns(array const &key) {
+    auto const rows = key.dims(1);
+    auto last = constant(1, dim4(1, rows), b8);
+    if (rows > 1) last(0, seq(0, rows - 2)) = key(0, seq(0, rows - 2)) != key(0, seq(1, rows - 1));
+    return last;
+}
 
+/* Cash balance of every account at its last transaction of each day. Opening holds the balance each account carried
+ * into these transactions, one row per AccountID, and is empty for the historical load. Closing, when given, gets
+ * the balance each account leaves these transactions with, in the same layout */
+static AFDataFrame cashBalances(AFDataFrame &&s_Cash, AFDataFrame &opening, AFDataFrame &dimAccount,
+                                AFDataFrame &dimCustomer, AFDataFrame &dimDate, unsigned int const batchID,
+                                AFDataFrame *closing = nullptr) {
+    AFDataFrame cash;
+    cash.name("Cash");
+    AFDataFrame fact;
+    fact.name("FactCashBalances");
     {
-        AFDataFrame tmp;
-        tmp.name("LocalTax");
-        tmp.add(Column(frame.column(30)), "ID");
-        tmp = tmp.equiJoin(taxRate, "ID", "TX_ID");
-        dimCustomer.add(tmp.column("TaxRate.TX_NAME"), "LocalTaxRateDesc");
-        dimCustomer.add(tmp.column("TaxRate.TX_RATE"), "LocalTaxRate");
+        AFDataFrame staging(std::move(s_Cash));
+        if (staging.isEmpty()) return fact;
+        cash.add(staging(0), "AccountID");
+        cash.add(staging(1), "CT_DTS");
+        cash.add(staging(2), "Amount");
+    }
+    cash.sortBy({"AccountID", "CT_DTS"});
+    cash.add(datePart(cash("CT_DTS")), "Day");
+    cash.remove("CT_DTS");
+
+    // Running balance per account, kept at the last transaction of every account-day
+    auto const rows = cash.rows();
+    auto const segments = keySegments(cash("AccountID").data());
+    array balance = scanByKey(segments.first, cash("Amount").data().as(f64), 1, AF_BINARY_ADD);
+    if (!opening.isEmpty()) {
+        auto const carried = dictionaryLookup(cash("AccountID").hash(), opening("AccountID").hash());
+        balance += dictionaryColumn(opening("Cash"), carried).data().as(f64);
+    }
+    array const day = cash("Day").data();
+    auto last = constant(1, dim4(1, rows), b8);
+    if (rows > 1) {
+        last(0, seq(0, rows - 2)) = segments.first(0, seq(0, rows - 2)) != segments.first(0, seq(1, rows - 1)) ||
+                                    day(0, seq(0, rows - 2)) != day(0, seq(1, rows - 1));
+    }
+    cash.add(Column(balance), "Cash");
+    cash.remove("Amount");
+    cash = cash.select(last);
+    if (closing) {
+        *closing = cash.project({"AccountID", "Cash"}, "CashBalances");
+        *closing = closing->select(lastOfRuns(cash("AccountID").data()));
     }
 
-    return dimCustomer;
+    cash = joinEffective(cash, "AccountID", "Day", dimAccount, {"AccountID", "SK_AccountID", "CustomerID"}, "DA");
+    cash = joinEffective(cash, "DA.CustomerID", "Day", dimCustomer, {"CustomerID", "SK_CustomerID"}, "DC");
+    if (cash.isEmpty()) return fact;
+
+    fact.add(cash("DC.SK_CustomerID"), "SK_CustomerID");
+    fact.add(cash("DA.SK_AccountID"), "SK_AccountID");
+    fact.add(dimensionKey(cash("Day"), dimDate(1), dimDate(0)), "SK_DateID");
+    fact.add(cash("Cash"), "Cash");
+    fact.add(Column(constant(batchID, dim4(1, cash.rows()), u32)), "BatchID");
+    return fact;
 }
-#endif
 
+AFDataFrame loadFactCashBalances(AFDataFrame &&s_Cash, AFDataFrame &dimAccount, AFDataFrame &dimCustomer,
+                                 AFDataFrame &dimDate) {
+    Logger::ScopedTimer timer("FactCashBalances");
+    AFDataFrame opening;
+    auto fact = cashBalances(std::move(s_Cash), opening, dimAccount, dimCustomer, dimDate, 1);
+    timer.stop();
+    callGC();
+    return fact;
+}
+
+AFDataFrame loadFactHoldings(AFDataFrame &&s_Holdings, AFDataFrame &dimTrade) {
+    Logger::ScopedTimer timer("FactHoldings");
+    AFDataFrame holdings(std::move(s_Holdings));
+    AFDataFrame fact;
+    fact.name("FactHoldings");
+    if (holdings.isEmpty() || dimTrade.isEmpty()) return fact;
+
+    // TradeID is unique in DimTrade, so the holding's current trade is a dictionary lookup
+    auto const match = dictionaryLookup(holdings(1).hash(), dimTrade("TradeID").hash());
+    auto const found = match < dimTrade.rows();
+    array const rows = match(found);
+    auto trade = dimTrade.project({"SK_CustomerID", "SK_AccountID", "SK_SecurityID", "SK_CompanyID",
+                                   "SK_CloseDateID", "SK_CloseTimeID", "TradePrice"}).select(rows);
+
+    fact.add(holdings(0).select(found), "TradeID");
+    fact.add(holdings(1).select(found), "CurrentTradeID");
+    for (auto const name : {"SK_CustomerID", "SK_AccountID", "SK_SecurityID", "SK_CompanyID"}) {
+        fact.add(trade(name), name);
+    }
+    fact.add(trade("SK_CloseDateID"), "SK_DateID");
+    fact.add(trade("SK_CloseTimeID"), "SK_TimeID");
+    fact.add(trade("TradePrice"), "CurrentPrice");
+    fact.add(holdings(3).select(found), "CurrentHolding");
+    fact.add(Column(constant(1, dim4(1, fact.rows()), u32)), "BatchID");
+    timer.stop();
+    callGC();
+    return fact;
+}
+
+static array watchKey(AFDataFrame &watches) {
+    return (watches("CustomerID").hash() * 0x100000001b3llU) ^ watches("Symbol").hash();
+}
+
+AFDataFrame loadFactWatches(AFDataFrame &&s_Watches, AFDataFrame &dimCustomer, AFDataFrame &dimSecurity,
+                            AFDataFrame &dimDate) {
+    Logger::ScopedTimer timer("FactWatches");
+    AFDataFrame watches(std::move(s_Watches));
+    AFDataFrame fact;
+    fact.name("FactWatches");
+    if (watches.isEmpty()) return fact;
+    watches.name("Watches");
+    watches.nameColumn("CustomerID", 0);
+    watches.nameColumn("Symbol", 1);
+    watches.nameColumn("W_DTS", 2);
+    watches.nameColumn("Action", 3);
+
+    auto placed = watches.select(watches("Action") == "ACTV");
+    auto removed = watches.select(watches("Action") == "CNCL");
+    watches.clear();
+    placed.add(datePart(placed("W_DTS")), "DatePlaced");
+    if (removed.isEmpty()) {
+        placed.add(Column(constant(0, dim4(1, placed.rows()), u64)), "SK_DateID_DateRemoved");
+    } else {
+        auto const date = datePart(dictionaryColumn(removed("W_DTS"), dictionaryLookup(watchKey(placed),
+                                                                                        watchKey(removed))));
+        placed.add(dimensionKey(date, dimDate(1), dimDate(0)), "SK_DateID_DateRemoved");
+    }
+    removed.clear();
+
+    placed = joinEffective(placed, "CustomerID", "DatePlaced", dimCustomer, {"CustomerID", "SK_CustomerID"}, "DC");
+    placed = joinEffective(placed, "Symbol", "DatePlaced", dimSecurity, {"Symbol", "SK_SecurityID"}, "DS");
+    if (placed.isEmpty()) return fact;
+
+    fact.add(placed("DC.SK_CustomerID"), "SK_CustomerID");
+    fact.add(placed("DS.SK_SecurityID"), "SK_SecurityID");
+    fact.add(dimensionKey(placed("DatePlaced"), dimDate(1), dimDate(0)), "SK_DateID_DatePlaced");
+    fact.add(placed("SK_DateID_DateRemoved"), "SK_DateID_DateRemoved");
+    fact.add(Column(constant(1, dim4(1, placed.rows()), u32)), "BatchID");
+    timer.stop();
+    callGC();
+    return fact;
+}
+
+void markProspectCustomers(AFDataFrame &prospect, AFDataFrame &dimCustomer) {
+    if (prospect.isEmpty() || dimCustomer.isEmpty()) return;
+    Logger::ScopedTimer timer("Prospect IsCustomer");
+    auto current = dimCustomer.project({"LastName", "FirstName", "AddressLine1", "AddressLine2", "PostalCode",
+                                        "Status", "IsCurrent"}, "DC");
+    current = current.select(current("IsCurrent").data() && current("Status") == "Active");
+
+    // Distinct customer keys, so the left join keeps exactly one row per prospect
+    AFDataFrame customers;
+    customers.name("DC");
+    customers.add(Column(setUnique(sort(hflat(customerKey(current)), 1), true)), "Key");
+    current.clear();
+    prospect.add(Column(customerKey(prospect)), "CustomerKey");
+    array unmatched;
+    prospect = prospect.equiJoin(customers, {"CustomerKey"}, {"Key"}, LEFT, nullptr, &unmatched);
+    prospect("IsCustomer") = Column(!unmatched);
+    prospect.remove("DC.Key");
+    prospect.remove("CustomerKey");
+    prospect.name("Prospect");
+    timer.stop();
+}
+
+/* Date of an incremental batch repeated for every row, CDC records take effect on it */
+static Column batchDateColumn(AFDataFrame &batchDate, dim_t const rows) {
+    return Column(tile(batchDate(1).data()(0), dim4(1, rows)), DATE);
+}
+
+void updateDimCustomer(AFDataFrame &dimCustomer, AFDataFrame &&s_Customer, AFDataFrame &statusType,
+                       AFDataFrame &taxRate, AFDataFrame &prospect, AFDataFrame &batchDate, unsigned int const batchID) {
+    Logger::ScopedTimer timer("DimCustomer Update");
+    AFDataFrame staging(std::move(s_Customer));
+    if (staging.isEmpty()) return;
+    // Customer.txt rows are complete versions, nothing is inherited from the current row
+    auto customer = customerActions(staging, "Active", false);
+    customer("Status") = dimensionKey(staging(1), statusType("ST_ID"), statusType("ST_NAME"));
+    staging.clear();
+    customer("ActionTS") = batchDateColumn(batchDate, customer.rows());
+    formatPhones(customer);
+    auto delta = customerDimension(customer, taxRate, prospect, batchID);
+    customer.clear();
+    dimCustomer.appendSCD2(delta, "CustomerID", "EffectiveDate", "SK_CustomerID");
+    timer.stop();
+    callGC();
+}
+
+void updateDimAccount(AFDataFrame &dimAccount, AFDataFrame &&s_Account, AFDataFrame &statusType,
+                      AFDataFrame &batchDate, unsigned int const batchID) {
+    Logger::ScopedTimer timer("DimAccount Update");
+    AFDataFrame staging(std::move(s_Account));
+    if (staging.isEmpty()) return;
+    auto const rows = staging.rows();
+    AFDataFrame delta;
+    delta.name("DimAccount");
+    delta.add(Column(range(dim4(1, rows), 1, u64)), "SK_AccountID");
+    delta.add(staging(0), "AccountID");
+    delta.add(staging(1), "BrokerID");
+    delta.add(staging(2), "CustomerID");
+    delta.add(dimensionKey(staging(5), statusType("ST_ID"), statusType("ST_NAME")), "Status");
+    delta.add(staging(3), "AccountDesc");
+    delta.add(staging(4), "TaxStatus");
+    delta.add(Column(constant(1, dim4(1, rows), b8)), "IsCurrent");
+    delta.add(Column(constant(batchID, dim4(1, rows), u32)), "BatchID");
+    delta.add(batchDateColumn(batchDate, rows), "EffectiveDate");
+    delta.add(Utils::endDate(rows), "EndDate");
+    staging.clear();
+    dimAccount.appendSCD2(delta, "AccountID", "EffectiveDate", "SK_AccountID");
+    timer.stop();
+    callGC();
+}
+
+void updateDimTrade(AFDataFrame &dimTrade, AFDataFrame &&s_Trade, AFDataFrame &statusType, AFDataFrame &tradeType,
+                    AFDataFrame &dimAccount, AFDataFrame &dimSecurity, AFDataFrame &dimCustomer, AFDataFrame &dimBroker,
+                    AFDataFrame &dimDate, AFDataFrame &dimTime, unsigned int const batchID) {
+    Logger::ScopedTimer timer("DimTrade Update");
+    AFDataFrame trade(std::move(s_Trade));
+    if (trade.isEmpty()) return;
+    array const inserted = trade(14) == "I";
+    trade.remove(14);
+    nameTrade(trade);
+
+    // A new trade is built like a historical one, its own record standing in for the trade history: created at its
+    // T_DTS whatever its status, and closed then too when it arrives completed or cancelled
+    auto added = trade.select(inserted);
+    if (!added.isEmpty()) {
+        auto history = added.project({"TradeID", "T_DTS"}, "TradeHistory");
+        history.add(stringConstant("SBMT", history.rows()), "T_ST_ID");
+        auto closed = added.select(added("T_ST_ID") == "CMPT" || added("T_ST_ID") == "CNCL");
+        if (!closed.isEmpty()) history = history.unionize(closed.project({"TradeID", "T_DTS", "T_ST_ID"}));
+        auto delta = loadDimTrade(std::move(added), std::move(history), statusType, tradeType, dimAccount, dimSecurity,
+                                  dimCustomer, dimBroker, dimDate, dimTime);
+        if (!delta.isEmpty()) {
+            delta("BatchID") = Column(constant(batchID, dim4(1, delta.rows()), u32));
+            dimTrade.upsert(delta, "TradeID");
+        }
+    }
+
+    // An update moves an existing trade to its latest status, keeping where and when it was created
+    auto updated = trade.select(!inserted);
+    trade.clear();
+    if (!updated.isEmpty() && !dimTrade.isEmpty()) {
+        updated.sortBy({"TradeID", "T_DTS"}, {true, false});
+        array const id = updated("TradeID").data();
+        auto latest = constant(1, dim4(1, updated.rows()), b8);
+        if (updated.rows() > 1) latest(0, seq(1, end)) = id(0, seq(1, end)) != id(0, seq(0, end - 1));
+        updated = updated.select(latest);
+
+        auto const match = dictionaryLookup(updated("TradeID").hash(), dimTrade("TradeID").hash());
+        array const found = match < dimTrade.rows();
+        updated = updated.select(found);
+        auto delta = dimTrade.select(match(found));
+        if (!delta.isEmpty()) {
+            array const closing = updated("T_ST_ID") == "CMPT" || updated("T_ST_ID") == "CNCL";
+            auto const closeKey = [&closing](Column const &key, Column const &current) {
+                return Column(af::select(closing, key.data(), current.data()), current.type());
+            };
+            delta("SK_CloseDateID") = closeKey(dimensionKey(datePart(updated("T_DTS")), dimDate(1), dimDate(0)),
+                                               delta("SK_CloseDateID"));
+            delta("SK_CloseTimeID") = closeKey(dimensionKey(timePart(updated("T_DTS")), dimTime(1), dimTime(0)),
+                                               delta("SK_CloseTimeID"));
+            delta("Status") = dimensionKey(updated("T_ST_ID"), statusType("ST_ID"), statusType("ST_NAME"));
+            for (auto const name : {"TradePrice", "Fee", "Commission", "Tax"}) delta(name) = updated(name);
+            delta("BatchID") = Column(constant(batchID, dim4(1, delta.rows()), u32));
+            dimTrade.upsert(delta, "TradeID");
+        }
+    }
+    timer.stop();
+    callGC();
+}
+
+AFDataFrame latestCashBalances(AFDataFrame &fact, AFDataFrame &dimAccount) {
+    AFDataFrame balances;
+    balances.name("CashBalances");
+    if (fact.isEmpty()) return balances;
+    // The account of each row is taken from the version the fact references, the latest day of an account wins
+    balances.add(dimensionKey(fact("SK_AccountID"), dimAccount("SK_AccountID"), dimAccount("AccountID")), "AccountID");
+    balances.add(fact("SK_DateID"), "SK_DateID");
+    balances.add(fact("Cash"), "Cash");
+    balances.sortBy({"AccountID", "SK_DateID"});
+    balances = balances.select(lastOfRuns(balances("AccountID").data()));
+    balances.remove("SK_DateID");
+    return balances;
+}
+
+void updateFactCashBalances(AFDataFrame &fact, AFDataFrame &balances, AFDataFrame &&s_Cash, AFDataFrame &dimAccount,
+                            AFDataFrame &dimCustomer, AFDataFrame &dimDate, unsigned int const batchID) {
+    Logger::ScopedTimer timer("FactCashBalances Update");
+    // Balances carry on from each account's latest one, which moves on with every batch
+    AFDataFrame closing;
+    auto delta = cashBalances(std::move(s_Cash), balances, dimAccount, dimCustomer, dimDate, batchID, &closing);
+    balances.upsert(closing, "AccountID");
+    if (!delta.isEmpty()) fact = fact.isEmpty() ? delta : fact.unionize(delta);
+    timer.stop();
+    callGC();
+}
+
+void updateFactHoldings(AFDataFrame &fact, AFDataFrame &&s_Holdings, AFDataFrame &dimTrade,
+                        unsigned int const batchID) {
+    auto delta = loadFactHoldings(std::move(s_Holdings), dimTrade);
+    if (delta.isEmpty()) return;
+    delta("BatchID") = Column(constant(batchID, dim4(1, delta.rows()), u32));
+    fact = fact.isEmpty() ? delta : fact.unionize(delta);
+}
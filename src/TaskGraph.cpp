@@ -0,0 +1,128 @@
+#include "TaskGraph.h"
+#include "MemoryManager.h"
+#include "Logger.h"
+#include <arrayfire.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+void TaskGraph::add(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs,
+                    size_t const memory, std::function<void()> work) {
+    add(std::move(name), std::move(inputs), std::move(outputs), [memory]() { return memory; }, std::move(work));
+}
+
+void TaskGraph::add(std::string name, std::vector<std::string> inputs, std::vector<std::string> outputs,
+                    std::function<size_t()> memory, std::function<void()> work) {
+    _tasks.push_back({std::move(name), std::move(inputs), std::move(outputs), std::move(memory), std::move(work)});
+}
+
+void TaskGraph::release(std::string const &table, std::function<void()> action) {
+    _release[table] = std::move(action);
+}
+
+void TaskGraph::run(size_t const budget, unsigned int workers) {
+    if (!workers) workers = std::max(2u, std::thread::hardware_concurrency());
+    std::unordered_set<std::string> declared;
+    std::unordered_set<std::string> produced;
+    std::unordered_map<std::string, size_t> readers;
+    for (auto const &task : _tasks) {
+        for (auto const &table : task.outputs) {
+            if (!declared.insert(table).second) throw std::runtime_error(table + " is produced by more than one task");
+        }
+    }
+    for (auto const &task : _tasks) {
+        for (auto const &table : task.inputs) {
+            if (!declared.count(table)) throw std::runtime_error(task.name + " reads " + table + " which nothing produces");
+            ++readers[table];
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable done;
+    std::deque<size_t> finished;
+    std::vector<std::thread> threads;
+    std::vector<bool> started(_tasks.size(), false);
+    std::vector<size_t> estimates(_tasks.size(), 0);
+    std::exception_ptr failure;
+    size_t running = 0;
+    size_t reserved = 0;
+    size_t completed = 0;
+    // The ArrayFire device and the open spans are per thread, workers run on the caller's device under its span
+    auto const device = af::getDevice();
+    auto const parent = Logger::currentSpan();
+
+    std::unique_lock<std::mutex> guard(lock);
+    while (completed < _tasks.size()) {
+        // A task larger than the whole budget still gets to run once nothing else is running
+        for (size_t t = 0; !failure && t < _tasks.size() && running < workers; ++t) {
+            auto const &task = _tasks[t];
+            if (started[t]) continue;
+            auto const ready = std::all_of(task.inputs.begin(), task.inputs.end(),
+                                           [&produced](std::string const &table) { return produced.count(table); });
+            if (!ready) continue;
+            // Inputs of a ready task are final, its estimate is taken once
+            if (!estimates[t]) estimates[t] = std::max<size_t>(task.memory(), 1);
+            if (running && reserved + estimates[t] > budget) continue;
+            started[t] = true;
+            ++running;
+            reserved += estimates[t];
+            for (auto const &table : task.inputs) MemoryManager::instance().pin(table);
+            for (auto const &table : task.outputs) MemoryManager::instance().pin(table);
+            threads.emplace_back([this, t, device, parent, &lock, &done, &finished, &failure]() {
+                std::exception_ptr error;
+                try {
+                    Logger::inheritSpan(parent);
+                    af::setDevice(device);
+                    _tasks[t].work();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> finish(lock);
+                if (error && !failure) failure = error;
+                finished.push_back(t);
+                done.notify_one();
+            });
+        }
+        if (!running) break;
+        done.wait(guard, [&finished]() { return !finished.empty(); });
+
+        std::vector<std::string> released;
+        for (; !finished.empty(); finished.pop_front()) {
+            auto const &task = _tasks[finished.front()];
+            --running;
+            reserved -= estimates[finished.front()];
+            ++completed;
+            for (auto const &table : task.inputs) MemoryManager::instance().unpin(table);
+            for (auto const &table : task.outputs) MemoryManager::instance().unpin(table);
+            for (auto const &table : task.outputs) {
+                produced.insert(table);
+                if (!readers[table]) released.push_back(table);
+            }
+            for (auto const &table : task.inputs) {
+                if (!--readers[table]) released.push_back(table);
+            }
+        }
+        if (failure) continue;
+
+        // Release actions touch only tables no task can still be using, so workers carry on meanwhile
+        guard.unlock();
+        try {
+            for (auto const &table : released) if (_release.count(table)) _release[table]();
+        } catch (...) {
+            guard.lock();
+            if (!failure) failure = std::current_exception();
+            continue;
+        }
+        guard.lock();
+    }
+    guard.unlock();
+
+    for (auto &thread : threads) thread.join();
+    if (failure) std::rethrow_exception(failure);
+    if (completed < _tasks.size()) throw std::runtime_error("Task graph has a cycle");
+}
@@ -1,13 +1,17 @@
 #include "Utils.h"
 #include "BatchFunctions.h"
 #include "Column.h"
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <thread>
 #include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <Logger.h>
+#include "MemoryManager.h"
+#include "Prefetcher.h"
 
-#define GC_RATIO 8
 using namespace af;
 using namespace BatchFunctions;
 
@@ -22,6 +26,12 @@ void printStr(array str_array, std::ostream &out) {
 }
 
 std::string Utils::loadFile(char const *filename) {
+    std::string text;
+    if (Prefetcher::instance().take(filename, text)) return text;
+    return readFile(filename);
+}
+
+std::string Utils::readFile(char const *filename) {
     std::ifstream file(filename);
     std::string text;
     file.seekg(0, std::ios::end);
@@ -71,6 +81,27 @@ std::string Utils::collect(std::vector<std::string> const &files, bool const has
     return output;
 }
 
+std::vector<std::string> Utils::listFiles(std::string const &directory, char const *prefix) {
+    std::vector<std::string> files;
+    auto const dir = opendir(directory.c_str());
+    if (!dir) return files;
+    for (auto entry = readdir(dir); entry; entry = readdir(dir)) {
+        if (!strncmp(entry->d_name, prefix, strlen(prefix))) files.emplace_back(directory + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+size_t Utils::fileBytes(std::string const &directory, char const *prefix) {
+    size_t bytes = 0;
+    for (auto const &file : listFiles(directory, prefix)) {
+        struct stat info;
+        if (!stat(file.c_str(), &info)) bytes += (size_t)info.st_size;
+    }
+    return bytes;
+}
+
 af::array Utils::where64(af::array const &input) {
     if (input.bytes() < UINT32_MAX) return where(input).as(u64);
     auto b = flat(input > 0);
@@ -78,10 +109,25 @@ af::array Utils::where64(af::array const &input) {
     return output(b);
 }
 
+af::array Utils::packBits(af::array const &mask) {
+    auto const rows = mask.elements();
+    auto const words = (rows + 31) / 32;
+    if (!rows) return array(0, u32);
+    auto bits = join(0, flat(mask).as(u32), constant(0, words * 32 - rows, u32));
+    bits = moddims(bits, dim4(32, words)) << range(dim4(32, words), 0, u32);
+    return hflat(sum(bits, 0).as(u32));
+}
+
+af::array Utils::unpackBits(af::array const &bits, dim_t const rows) {
+    if (!rows) return array(dim4(1, 0), b8);
+    auto const words = bits.elements();
+    auto out = (tile(moddims(bits, dim4(1, words)), 32) >> range(dim4(32, words), 0, u32)) & 1;
+    return hflat(flat(out)(seq((double)rows)).as(b8));
+}
+
 Column Utils::endDate(int length) {
-    auto a = join(0, af::constant(9999, 1, u16), af::constant(12, 1, u16), af::constant(31, 1, u16));
-    a = tile(a, dim4(1, length));
-    return Column(std::move(a), DATE);
+    // 9999-12-31 as days since 1970-01-01
+    return Column(af::constant(2932896, dim4(1, length), s32), DATE);
 }
 
 void Utils::fillBlanks(int &count, String fieldName, StrToInt &tracker, String &data, bool isAtt) {
@@ -175,11 +221,8 @@ std::string Utils::flattenCustomerMgmt(char const *directory) {
     std::string data;
     xml_document<> doc;
 
-    std::ifstream inFile(file);
-    std::vector<char> buffer((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    auto buffer = loadFile(file);
     data.reserve(buffer.size());
-    inFile.close();
-    buffer.push_back('\0');
     // Parse the buffer using the xml file parsing library into doc
     doc.parse<0>(&buffer[0]);
 
@@ -198,11 +241,7 @@ std::string Utils::flattenCustomerMgmt(char const *directory) {
 }
 
 void Utils::callGC() {
-    size_t alloc;
-    size_t locked;
-
-    deviceMemInfo(&alloc, nullptr, &locked, nullptr);
-    if (alloc / locked > GC_RATIO) deviceGC();
+    MemoryManager::instance().collect();
 }
 
 void Utils::MemInfo() {
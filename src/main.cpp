@@ -1,6 +1,13 @@
 #include <cstring>
+#include <functional>
 #include <string>
+#include <vector>
 #include "Logger.h"
+#include "MemoryManager.h"
+#include "Prefetcher.h"
+#include "SpillManager.h"
+#include "StagingCache.h"
+#include "TaskGraph.h"
 #include "TPCDI.h"
 #include "Tests.h"
 
@@ -18,10 +25,43 @@ namespace DIR {
     #else
     std::string DIRECTORY = "/home/jw5514/data/5/Batch1/";
     #endif
+    std::string OUTPUT;
+    std::string TEXT_OUTPUT;
+    /* Warehouse written by an earlier run with -w, incremental batches start from it */
+    std::string SNAPSHOT;
+    size_t DEVICE_BUDGET = SIZE_MAX;
 }
 
 void fullBenchmark();
 
+void incrementalBatches(unsigned int last);
+
+inline void persist(AFDataFrame const &table, char const *name) {
+    if (!DIR::OUTPUT.empty()) table.writeColumnar(DIR::OUTPUT, name);
+    if (!DIR::TEXT_OUTPUT.empty()) table.writeDelimited(DIR::TEXT_OUTPUT + "/" + name + ".txt");
+}
+
+/* Directory of an incremental batch, a sibling of the Batch1 directory */
+inline std::string batchDirectory(unsigned int const batch) {
+    auto dir = DIR::DIRECTORY;
+    auto const n = dir.rfind("Batch1");
+    if (n == std::string::npos) throw std::runtime_error("Expected a Batch1 directory");
+    return dir.replace(n, 6, "Batch" + std::to_string(batch));
+}
+
+/* Rough device footprint of a loader: the raw text plus the parsed columns */
+inline size_t inputBytes(char const *prefix) { return Utils::fileBytes(DIR::DIRECTORY, prefix) * 4; }
+
+/* Rough device footprint of a transform: its input frames a few times over for the join and sort temporaries */
+inline std::function<size_t()> frameBytes(std::initializer_list<AFDataFrame const *> frames) {
+    std::vector<AFDataFrame const *> inputs(frames);
+    return [inputs]() {
+        size_t bytes = 0;
+        for (auto const frame : inputs) bytes += MemoryManager::instance().footprint(*frame);
+        return bytes * 3;
+    };
+}
+
 void DimCompany();
 
 void DimSecurity();
@@ -44,6 +84,8 @@ int main(int argc, char *argv[]) {
         setBackend(AF_BACKEND_CPU);
     #endif
     int scale = 3;
+    unsigned int lastBatch = 1;
+    bool finwireOnly = false;
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i],"-f")) {           
             DIR::DIRECTORY = argv[++i];
@@ -52,6 +94,28 @@ int main(int argc, char *argv[]) {
             setDevice(std::stoi(argv[++i]));
         } else if (!strcmp(argv[i],"-o")) {
             Logger::directory(std::string(argv[++i]));
+        } else if (!strcmp(argv[i],"-x")) {
+            Logger::exactCounts() = true;
+        } else if (!strcmp(argv[i],"-w")) {
+            DIR::OUTPUT = argv[++i];
+        } else if (!strcmp(argv[i],"-r")) {
+            DIR::SNAPSHOT = argv[++i];
+        } else if (!strcmp(argv[i],"-b")) {
+            lastBatch = (unsigned int)std::stoul(argv[++i]);
+        } else if (!strcmp(argv[i],"-t")) {
+            DIR::TEXT_OUTPUT = argv[++i];
+        } else if (!strcmp(argv[i],"-B")) {
+            DIR::DEVICE_BUDGET = std::stoull(argv[++i]) << 20U;
+        } else if (!strcmp(argv[i],"-P")) {
+            Prefetcher::instance().limit(std::stoull(argv[++i]) << 20U);
+        } else if (!strcmp(argv[i],"-c")) {
+            StagingCache::directory(std::string(argv[++i]));
+        } else if (!strcmp(argv[i],"-s")) {
+            SpillManager::instance().directory(std::string(argv[++i]));
+        } else if (!strcmp(argv[i],"-M")) {
+            SpillManager::instance().budget(std::stoull(argv[++i]) << 20U);
+        } else if (!strcmp(argv[i],"-F")) {
+            finwireOnly = true;
         } else if (!strcmp(argv[i],"-I")) {
             info();
         } else if (!strcmp(argv[i], "-i")) {
@@ -61,11 +125,24 @@ int main(int argc, char *argv[]) {
     }
     //    for (int i = 0; i < 5; ++i) {
     
-    af::deviceGC();
+    MemoryManager::instance().budget(DIR::DEVICE_BUDGET);
+    MemoryManager::instance().collect();
     Logger::startTimer();
-    FinWire();
+    if (lastBatch > 1) {
+        incrementalBatches(lastBatch);
+    } else if (finwireOnly) {
+        FinWire();
+    } else {
+        fullBenchmark();
+    }
     Logger::logTime();
-//    Logger::sendToCSV(scale);
+    MemoryManager::instance().report();
+    // Memory counters go out as rows of result.csv, next to the timings
+    if (!Logger::directory().empty()) {
+        Logger::sendToCSV(scale);
+        Logger::sendToTrace();
+        Logger::sendThroughput();
+    }
         //    }
     
     return 0;
@@ -77,72 +154,190 @@ void DailyMarket() {
 }
 
 void fullBenchmark() {
-    auto batchDate = loadBatchDate(DIR::DIRECTORY.c_str());
-    print("DimDate");
-    auto dimDate = loadDimDate(DIR::DIRECTORY.c_str());
-    
-    print("Industry");
-    auto industry = loadIndustry(DIR::DIRECTORY.c_str());
-    
-    print("StatusType");
-    auto statusType = loadStatusType(DIR::DIRECTORY.c_str());
-    
-    print("TaxRate");
-    auto taxRate = loadTaxRate(DIR::DIRECTORY.c_str());
-    taxRate.flushToHost();
-
-    print("TradeType");
-    auto tradeType = loadTradeType(DIR::DIRECTORY.c_str());
-    tradeType.flushToHost();
-
-    print("Audit");
-    auto audit = loadAudit(DIR::DIRECTORY.c_str());
-    audit.flushToHost();
-    
-    print("Staging Prospect");
-    auto s_prospect = loadStagingProspect(DIR::DIRECTORY.c_str());
-    print("Prospect");
-    auto prospect = loadProspect(s_prospect, batchDate);
-    prospect.flushToHost();
-    batchDate.flushToHost();
-    s_prospect.clear();
-    af::deviceGC();
-    print("Staging Cash Balnces");
-    auto s_cash = loadStagingCashBalances(DIR::DIRECTORY.c_str());
-    s_cash.flushToHost();
-
-    print("Staging Watches");
-    auto s_watches = loadStagingWatches(DIR::DIRECTORY.c_str());
-    s_watches.flushToHost();
-
-    print("Staging Customer");
-    auto s_customer = loadStagingCustomer(DIR::DIRECTORY.c_str());
-    s_customer.flushToHost();
-
-    print("Finwire");
-    auto finwire = loadStagingFinwire(DIR::DIRECTORY.c_str());
-
-    print("DimCompany");
-    auto dimCompany = loadDimCompany(std::move(finwire.company), industry, statusType);
-    industry.flushToHost();
-    
-    print("Financial");
-    auto financial = loadFinancial(std::move(finwire.financial), dimCompany);
-    financial.flushToHost();
-    
-    print("DimSecurity");
-    auto dimSecurity = loadDimSecurity(std::move(finwire.security), dimCompany, statusType);
-    dimSecurity.flushToHost();
-    dimCompany.flushToHost();
-    statusType.flushToHost();
-    finwire.clear();
-   
+    auto const dir = DIR::DIRECTORY.c_str();
+    AFDataFrame batchDate, dimDate, industry, statusType, taxRate, tradeType, audit, s_prospect, prospect, s_cash,
+            s_watches, s_customer, dimCustomer, dimAccount, dimCompany, financial, dimSecurity, dimBroker, s_market,
+            factMarketHistory, dimTime, s_trade, s_tradeHistory, s_holdings, dimTrade, factCashBalances, factHoldings,
+            factWatches;
+    Finwire finwire{AFDataFrame(), AFDataFrame(), AFDataFrame()};
+    TaskGraph graph;
+
+    // Inputs are read ahead in the order the loaders are declared below
+    std::vector<std::string> inputs;
+    for (auto const name : {"BatchDate.txt", "Date.txt", "Industry.txt", "StatusType.txt", "TaxRate.txt", "TradeType.txt",
+                            "Prospect.csv", "CashTransaction.txt", "WatchHistory.txt", "CustomerMgmt.xml",
+                            "DailyMarket.txt", "Time.txt", "Trade.txt", "TradeHistory.txt", "HoldingHistory.txt"}) {
+        inputs.emplace_back(DIR::DIRECTORY + name);
+    }
+    for (auto const &file : Utils::listFiles(DIR::DIRECTORY, "FINWIRE")) {
+        if (file.find("_audit.csv") == std::string::npos) inputs.push_back(file);
+    }
+    inputs.emplace_back(DIR::DIRECTORY + "HR.csv");
+    Prefetcher::instance().schedule(inputs);
+
+    graph.add("BatchDate", {}, {"BatchDate"}, 0, [&]() { batchDate = loadBatchDate(dir); });
+    graph.add("DimDate", {}, {"DimDate"}, inputBytes("Date.txt"), [&]() { dimDate = loadDimDate(dir); });
+    graph.add("Industry", {}, {"Industry"}, inputBytes("Industry.txt"), [&]() { industry = loadIndustry(dir); });
+    graph.add("StatusType", {}, {"StatusType"}, inputBytes("StatusType.txt"), [&]() {
+        statusType = loadStatusType(dir);
+    });
+    graph.add("DimTime", {}, {"DimTime"}, inputBytes("Time.txt"), [&]() { dimTime = loadDimTime(dir); });
+    graph.add("TaxRate", {}, {"TaxRate"}, inputBytes("TaxRate.txt"), [&]() { taxRate = loadTaxRate(dir); });
+    graph.add("TradeType", {}, {"TradeType"}, inputBytes("TradeType.txt"), [&]() { tradeType = loadTradeType(dir); });
+    graph.add("Audit", {}, {"Audit"}, 0, [&]() { audit = loadAudit(dir); });
+    graph.add("StagingProspect", {}, {"StagingProspect"}, inputBytes("Prospect.csv"), [&]() {
+        s_prospect = loadStagingProspect(dir);
+    });
+    graph.add("Prospect", {"StagingProspect", "BatchDate"}, {"Prospect"}, inputBytes("Prospect.csv"), [&]() {
+        prospect = loadProspect(s_prospect, batchDate);
+    });
+    graph.add("StagingCashBalances", {}, {"StagingCashBalances"}, inputBytes("CashTransaction.txt"), [&]() {
+        s_cash = loadStagingCashBalances(dir);
+    });
+    graph.add("StagingWatches", {}, {"StagingWatches"}, inputBytes("WatchHistory.txt"), [&]() {
+        s_watches = loadStagingWatches(dir);
+    });
+    graph.add("StagingCustomer", {}, {"StagingCustomer"}, inputBytes("CustomerMgmt.xml"), [&]() {
+        s_customer = loadStagingCustomer(dir);
+    });
+    graph.add("DimCustomer", {"StagingCustomer", "TaxRate", "Prospect"}, {"DimCustomer"},
+              frameBytes({&s_customer, &taxRate, &prospect}), [&]() {
+        auto customer = splitCustomer(AFDataFrame(s_customer));
+        dimCustomer = loadDimCustomer(customer, taxRate, prospect);
+    });
+    graph.add("ProspectCustomers", {"Prospect", "DimCustomer"}, {}, frameBytes({&prospect, &dimCustomer}), [&]() {
+        markProspectCustomers(prospect, dimCustomer);
+    });
+    graph.add("DimAccount", {"StagingCustomer"}, {"DimAccount"}, frameBytes({&s_customer}), [&]() {
+        auto customer = splitCustomer(AFDataFrame(s_customer));
+        dimAccount = loadDimAccount(customer);
+    });
+    graph.add("Finwire", {}, {"Finwire"}, inputBytes("FINWIRE"), [&]() { finwire = loadStagingFinwire(dir); });
+    graph.add("DimCompany", {"Finwire", "Industry", "StatusType"}, {"DimCompany"},
+              frameBytes({&finwire.company, &industry, &statusType}), [&]() {
+        dimCompany = loadDimCompany(std::move(finwire.company), industry, statusType);
+    });
+    graph.add("Financial", {"Finwire", "DimCompany"}, {"Financial"}, frameBytes({&finwire.financial, &dimCompany}),
+              [&]() {
+        financial = loadFinancial(std::move(finwire.financial), dimCompany);
+    });
+    graph.add("DimSecurity", {"Finwire", "DimCompany", "StatusType"}, {"DimSecurity"},
+              frameBytes({&finwire.security, &dimCompany, &statusType}), [&]() {
+        dimSecurity = loadDimSecurity(std::move(finwire.security), dimCompany, statusType);
+    });
+    graph.add("DimBroker", {"DimDate"}, {"DimBroker"}, inputBytes("HR.csv"), [&]() {
+        dimBroker = loadDimBroker(dir, dimDate);
+    });
+    graph.add("StagingMarket", {}, {"StagingMarket"}, inputBytes("DailyMarket.txt"), [&]() {
+        s_market = loadStagingMarket(dir);
+    });
+    graph.add("FactMarketHistory", {"StagingMarket", "DimSecurity", "DimDate", "Financial"}, {"FactMarketHistory"},
+              frameBytes({&s_market, &dimSecurity, &dimDate, &financial}), [&]() {
+        factMarketHistory = loadFactMarketHistory(std::move(s_market), dimSecurity, dimDate, financial);
+    });
+
+    graph.add("StagingTrade", {}, {"StagingTrade"}, inputBytes("Trade.txt"), [&]() {
+        s_trade = loadStagingTrade(dir);
+    });
+    graph.add("StagingTradeHistory", {}, {"StagingTradeHistory"}, inputBytes("TradeHistory.txt"), [&]() {
+        s_tradeHistory = loadStagingTradeHistory(dir);
+    });
+    graph.add("StagingHoldings", {}, {"StagingHoldings"}, inputBytes("HoldingHistory.txt"), [&]() {
+        s_holdings = loadStagingHoldings(dir);
+    });
+    graph.add("DimTrade", {"StagingTrade", "StagingTradeHistory", "StatusType", "TradeType", "DimAccount",
+                           "DimSecurity", "DimCustomer", "DimBroker", "DimDate", "DimTime"}, {"DimTrade"},
+              frameBytes({&s_trade, &s_tradeHistory, &statusType, &tradeType, &dimAccount, &dimSecurity, &dimCustomer,
+                          &dimBroker, &dimDate, &dimTime}), [&]() {
+        dimTrade = loadDimTrade(std::move(s_trade), std::move(s_tradeHistory), statusType, tradeType, dimAccount,
+                                dimSecurity, dimCustomer, dimBroker, dimDate, dimTime);
+    });
+    graph.add("FactCashBalances", {"StagingCashBalances", "DimAccount", "DimCustomer", "DimDate"}, {"FactCashBalances"},
+              frameBytes({&s_cash, &dimAccount, &dimCustomer, &dimDate}), [&]() {
+        factCashBalances = loadFactCashBalances(std::move(s_cash), dimAccount, dimCustomer, dimDate);
+    });
+    graph.add("FactHoldings", {"StagingHoldings", "DimTrade"}, {"FactHoldings"}, frameBytes({&s_holdings, &dimTrade}),
+              [&]() {
+        factHoldings = loadFactHoldings(std::move(s_holdings), dimTrade);
+    });
+    graph.add("FactWatches", {"StagingWatches", "DimCustomer", "DimSecurity", "DimDate"}, {"FactWatches"},
+              frameBytes({&s_watches, &dimCustomer, &dimSecurity, &dimDate}), [&]() {
+        factWatches = loadFactWatches(std::move(s_watches), dimCustomer, dimSecurity, dimDate);
+    });
+
+    // Tables are persisted and flushed off the device once nothing reads them any more
+    std::pair<char const *, AFDataFrame *> const tables[] = {
+            {"DimDate", &dimDate}, {"Industry", &industry}, {"StatusType", &statusType}, {"TaxRate", &taxRate},
+            {"TradeType", &tradeType}, {"Prospect", &prospect}, {"DimCustomer", &dimCustomer},
+            {"DimAccount", &dimAccount},
+            {"DimCompany", &dimCompany}, {"Financial", &financial}, {"DimSecurity", &dimSecurity},
+            {"DimBroker", &dimBroker}, {"FactMarketHistory", &factMarketHistory}, {"DimTime", &dimTime},
+            {"DimTrade", &dimTrade}, {"FactCashBalances", &factCashBalances}, {"FactHoldings", &factHoldings},
+            {"FactWatches", &factWatches}};
+    // Produced tables are flushed early when the device runs over budget, the graph pins those a task still uses
+    for (auto const &table : tables) {
+        MemoryManager::instance().track(table.first, table.second);
+        graph.release(table.first, [table]() {
+            MemoryManager::instance().untrack(table.first);
+            persist(*table.second, table.first);
+            table.second->flushToHost();
+        });
+    }
+    graph.release("BatchDate", [&]() { batchDate.flushToHost(); });
+    graph.release("Audit", [&]() { audit.flushToHost(); });
+    graph.release("StagingCashBalances", [&]() { s_cash.clear(); });
+    graph.release("StagingWatches", [&]() { s_watches.clear(); });
+    graph.release("StagingTrade", [&]() { s_trade.clear(); });
+    graph.release("StagingTradeHistory", [&]() { s_tradeHistory.clear(); });
+    graph.release("StagingHoldings", [&]() { s_holdings.clear(); });
+    graph.release("StagingCustomer", [&]() { s_customer.flushToHost(); });
+    graph.release("StagingProspect", [&]() {
+        s_prospect.clear();
+        MemoryManager::instance().collect();
+    });
+    graph.release("Finwire", [&]() { finwire.clear(); });
+    graph.release("StagingMarket", [&]() { s_market.clear(); });
+    graph.run(DIR::DEVICE_BUDGET);
+}
 
-    print("DimBroker");
-    auto dimBroker = loadDimBroker(DIR::DIRECTORY.c_str(), dimDate);
-    dimBroker.flushToHost();
-    dimDate.flushToHost();
+/* Applies batches 2 to last on the warehouse read back from the snapshot. Tables stay in memory between batches and
+ * are persisted once the last batch is in, each batch only touches the rows of its CDC records */
+void incrementalBatches(unsigned int const last) {
+    if (DIR::SNAPSHOT.empty()) throw std::runtime_error("Incremental batches need a snapshot directory (-r)");
+    AFDataFrame statusType, taxRate, tradeType, dimDate, dimTime, dimBroker, dimSecurity, dimCustomer, dimAccount,
+            dimTrade, factCashBalances, factHoldings;
+    std::pair<char const *, AFDataFrame *> const tables[] = {
+            {"StatusType", &statusType}, {"TaxRate", &taxRate}, {"TradeType", &tradeType}, {"DimDate", &dimDate},
+            {"DimTime", &dimTime}, {"DimBroker", &dimBroker}, {"DimSecurity", &dimSecurity},
+            {"DimCustomer", &dimCustomer}, {"DimAccount", &dimAccount}, {"DimTrade", &dimTrade},
+            {"FactCashBalances", &factCashBalances}, {"FactHoldings", &factHoldings}};
+    for (auto const &table : tables) *table.second = AFDataFrame::readColumnar(DIR::SNAPSHOT, table.first);
+    auto cashBalances = latestCashBalances(factCashBalances, dimAccount);
+
+    for (unsigned int batch = 2; batch <= last; ++batch) {
+        auto const directory = batchDirectory(batch);
+        auto const dir = directory.c_str();
+        auto const name = "Batch" + std::to_string(batch);
+        Logger::startTimer(name);
+        auto batchDate = loadBatchDate(dir);
+        auto s_prospect = loadStagingProspect(dir);
+        auto prospect = loadProspect(s_prospect, batchDate);
+        updateDimCustomer(dimCustomer, loadStagingIncrementalCustomer(dir), statusType, taxRate, prospect, batchDate,
+                          batch);
+        prospect.clear();
+        updateDimAccount(dimAccount, loadStagingAccount(dir), statusType, batchDate, batch);
+        updateDimTrade(dimTrade, loadStagingTrade(dir, true), statusType, tradeType, dimAccount, dimSecurity,
+                       dimCustomer, dimBroker, dimDate, dimTime, batch);
+        updateFactCashBalances(factCashBalances, cashBalances, loadStagingCashBalances(dir, true), dimAccount,
+                               dimCustomer, dimDate, batch);
+        updateFactHoldings(factHoldings, loadStagingHoldings(dir, true), dimTrade, batch);
+        Logger::logTime(name, false);
+    }
 
+    std::pair<char const *, AFDataFrame *> const updated[] = {
+            {"DimCustomer", &dimCustomer}, {"DimAccount", &dimAccount}, {"DimTrade", &dimTrade},
+            {"FactCashBalances", &factCashBalances}, {"FactHoldings", &factHoldings}};
+    for (auto const &table : updated) persist(*table.second, table.first);
 }
 
 void DimCompany() {